@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+#define ARENA_CHUNK_SIZE (1 << 20)
+
+// Bump allocator for the boards built while exploring or solving. Freeing is
+// a no-op, memory comes back all at once when the Scope that handed it out
+// ends. An arena belongs to one thread.
+class Arena : public std::pmr::memory_resource
+{
+  private:
+    std::vector<char*> chunks_;
+    size_t chunk_;  // index of the chunk being filled
+    size_t offset_; // first free byte of that chunk
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {};
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    };
+
+  public:
+    Arena() : chunk_(0), offset_(0) {};
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // the memory the Fields of this thread are built with: the arena of the
+    // innermost Scope, the heap outside of any Scope
+    static std::pmr::memory_resource* current();
+
+    // Makes the arena current on this thread. Everything allocated from it
+    // during the scope is released in O(1) when the scope ends, so no Field
+    // built inside may outlive it. Chunks are kept for the next scope.
+    class Scope
+    {
+      private:
+        Arena& arena_;
+        std::pmr::memory_resource* previous_;
+        size_t chunk_;
+        size_t offset_;
+
+      public:
+        explicit Scope(Arena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // scratch arena of the calling thread
+    static Arena& local();
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "StateGraph.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// out[t] = reward[t] + coef[t] * V[next[t]] for t in [0, n)
+using TransitionKernel = void (*)(const int32_t* next,
+                                  const double* reward,
+                                  const double* coef,
+                                  const double* V,
+                                  size_t n,
+                                  double* out);
+
+// Bellman backups of a StateGraph on flat per-transition arrays. The value
+// of every transition is computed by a vectorized kernel (AVX-512, AVX2 or
+// scalar, picked at runtime for the CPU), the reductions over pieces and
+// actions keep the order and tie-breaking of the scalar solvers. Kernels
+// multiply then add, so all of them give bit-identical values.
+class BellmanBackup
+{
+  private:
+    const StateGraph& graph_;
+    std::vector<int32_t> next_;
+    std::vector<double> reward_;
+    std::vector<double> coef_;
+    TransitionKernel kernel_;
+
+  public:
+    // reward and coef hold one entry per transition of the graph
+    BellmanBackup(const StateGraph& graph,
+                  std::vector<double> reward,
+                  std::vector<double> coef);
+
+    // Jacobi sweep of max over actions of the sum over pieces, returns
+    // max |VOut - V| and stores the greedy action ids if policy is given
+    double expectationMax(const std::vector<double>& V,
+                          std::vector<double>& VOut,
+                          std::vector<int>* policy) const;
+
+    // Gauss-Seidel sweep of max over actions of the min over pieces, in
+    // place, with the chosen action and piece of every state; returns the
+    // largest change
+    double minMax(std::vector<double>& V,
+                  std::vector<int>& bestAction,
+                  std::vector<int>& worstPiece) const;
+
+    // kernels this CPU can run, best first; the first one is used
+    struct Kernel
+    {
+        const char* name; // "avx512", "avx2" or "scalar"
+        TransitionKernel run;
+    };
+    static const std::vector<Kernel>& kernels();
+    void setKernel(TransitionKernel kernel) { kernel_ = kernel; };
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Action.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NO_CHECKPOINT_ACTION -1 // rotation stored for a state without action
+
+// Snapshot of a value iteration: one entry per state, identified by its
+// State::key(), with its value and greedy action.
+struct Checkpoint
+{
+    int width;
+    int height;
+    int nbPieces;
+    int iteration; // last sweep done
+    double delta;  // residual of that sweep
+    std::vector<uint64_t> keys;
+    std::vector<double> values;
+    std::vector<Action> actions;
+
+    // binary little-endian file, written to path + ".tmp" then renamed so a
+    // crash never leaves a half written checkpoint behind
+    void save(const std::string& path) const;
+    static Checkpoint load(const std::string& path);
+};
+
+// Writes checkpoints on a background thread. A snapshot submitted while the
+// previous one is still being written replaces the pending one, the solver
+// never waits for the disk.
+class CheckpointWriter
+{
+  private:
+    std::string path_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::optional<Checkpoint> pending_;
+    bool stopping_;
+    std::thread thread_;
+
+    void run();
+
+  public:
+    explicit CheckpointWriter(std::string path);
+    // writes the pending snapshot, if any, before returning
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    void submit(Checkpoint checkpoint);
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "StateGraph.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#define NO_ACTION_INDEX 0xFF // terminal state or no action in the policy
+#define MAX_ACTION_INDEX 0xFE
+
+// A policy as one byte per state id of a StateGraph: the index of the chosen
+// action among the actions of the state.
+class CompactPolicy
+{
+  private:
+    std::vector<uint8_t> indices_;
+
+  public:
+    CompactPolicy() = default;
+    CompactPolicy(const StateGraph& graph,
+                  const std::unordered_map<State, Action>& policy);
+    // from action ids of the graph as computed by the graph solvers, -1 for
+    // no action
+    CompactPolicy(const StateGraph& graph, const std::vector<int>& actionIds);
+
+    int size() const { return indices_.size(); };
+    int getIndex(int id) const { return indices_[id]; };
+    // action id in the graph, -1 if none
+    int getActionId(const StateGraph& graph, int id) const;
+    std::unordered_map<State, Action> toActionMap(const StateGraph& graph) const;
+    const std::vector<uint8_t>& getIndices() const { return indices_; };
+
+    // number of states whose action differs, both policies must come from
+    // the same graph
+    size_t diff(const CompactPolicy& other) const;
+};
+
+// An adversary as bit planes: bit s of plane j is bit j of the piece chosen
+// in state s, and a presence bit tells whether the state has a choice at all
+// (the piece is random otherwise). Two pieces need one plane.
+class CompactAdversary
+{
+  private:
+    int size_;
+    std::vector<uint64_t> present_;
+    std::vector<std::vector<uint64_t>> planes_;
+
+  public:
+    CompactAdversary(
+        const StateGraph& graph,
+        const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy);
+
+    int size() const { return size_; };
+    // RANDOM_PIECE where the adversary has no choice
+    int getPiece(int id) const;
+    // same layout as CompiledPolicy::compileAdversary
+    std::vector<int8_t> toPieces() const;
+
+    size_t diff(const CompactAdversary& other) const;
+};
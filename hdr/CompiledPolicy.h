@@ -0,0 +1,89 @@
+#pragma once
+
+#include "StateGraph.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#define NO_ACTION -1     // game over, the state has no available action
+#define MISSING_ACTION -2 // the policy has no action for the state
+#define RANDOM_PIECE -1
+// score columns whose total probability stays below this are dropped
+#define DISTRIBUTION_CUTOFF 1e-18
+
+// Distribution of the final score and of the number of moves of the games
+// played by a policy, cut after horizon moves
+struct GameDistribution
+{
+    std::vector<double> score;  // score[x] = P(final score == x)
+    std::vector<double> length; // length[t] = P(the game lasts t moves)
+    double truncated;           // probability dropped from the score tails
+
+    double meanScore() const;
+    // smallest x with P(score <= x) >= q, same for the length
+    int scoreQuantile(double q) const;
+    int lengthQuantile(double q) const;
+};
+
+// A policy resolved against a StateGraph: playing a move is reading the
+// successor of the chosen action for the drawn piece, no State is built.
+class CompiledPolicy
+{
+  private:
+    const StateGraph& graph_;
+    int nbPieces_;
+    std::vector<int32_t> next_; // nbPieces_ successor ids per state
+    std::vector<uint8_t> score_;
+    int start_;
+    std::vector<int32_t> roots_; // s0 with each possible first piece
+
+    // Markov chain of the game restricted to the states it reaches, indexed
+    // 0..n-1; succ and proba hold nbPieces_ entries per state, -1 and 0
+    // for game over states and pieces the adversary never gives
+    struct InducedChain
+    {
+        std::vector<int32_t> succ;
+        std::vector<double> proba;
+        std::vector<double> reward;
+        std::vector<std::pair<int32_t, double>> start; // first states
+    };
+    InducedChain inducedChain(const std::vector<int8_t>& adversary) const;
+
+    double pieceProbability(const std::vector<int8_t>& adversary,
+                            int id,
+                            int piece) const;
+    void checkAction(int id) const;
+
+  public:
+    CompiledPolicy(const StateGraph& graph,
+                   const State& s0,
+                   const std::unordered_map<State, Action>& policy);
+
+    // one piece per state id, RANDOM_PIECE where the adversary has no choice
+    static std::vector<int8_t> compileAdversary(
+        const StateGraph& graph,
+        const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy);
+
+    // same game as MDP::playPolicy, returns the final score
+    int play(const std::vector<int8_t>& adversary) const;
+
+    // exact mean of play() over the random pieces, games cut after horizon
+    // moves as in playPolicy
+    double expectedScore(const std::vector<int8_t>& adversary,
+                         int horizon) const;
+
+    // distribution of the score and length of play(), by moving the joint
+    // probability of (state, score) forward one move at a time; the score
+    // columns below DISTRIBUTION_CUTOFF are dropped into truncated, so the
+    // quantiles are those of the remaining mass. The states are split
+    // between nbThreads workers started once for all the moves
+    GameDistribution distribution(const std::vector<int8_t>& adversary,
+                                  int horizon,
+                                  int nbThreads) const;
+
+    int next(int id, int piece) const { return next_[(size_t)id * nbPieces_ + piece]; };
+    int score(int id) const { return score_[id]; };
+    int getStart() const { return start_; };
+    int getRoot(int piece) const { return roots_[piece]; };
+};
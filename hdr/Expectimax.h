@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Player.h"
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#define TT_MAX_ENTRIES 4000000
+
+// Online player for boards too large to enumerate: expectimax over the
+// available actions (max) and the piece distribution (chance), deepened
+// iteratively until the per-move time budget runs out.
+class Expectimax : public Player
+{
+  private:
+    struct Entry
+    {
+        int depth;
+        double value;
+    };
+    struct BoardHash
+    {
+        size_t operator()(const std::vector<uint64_t>& key) const;
+    };
+
+    int maxDepth_;
+    double timeBudget_; // in milliseconds, <= 0 for depth-limited only
+    double lambda_;
+    LeafEvaluator evaluator_;
+    std::unordered_map<std::vector<uint64_t>, Entry, BoardHash> table_;
+    std::chrono::steady_clock::time_point deadline_;
+    bool timedOut_;
+    long nodes_;
+    int lastDepth_;
+
+    double search(const State& state, int depth);
+    static std::vector<uint64_t> packBoard(const State& state);
+
+  public:
+    Expectimax(int maxDepth,
+               double timeBudget,
+               double lambda,
+               LeafEvaluator evaluator);
+
+    Action chooseAction(const State& state) override;
+
+    // depth reached by the last chooseAction
+    int getLastDepth() const { return lastDepth_; };
+    long getNodes() const { return nodes_; };
+
+    // the height and gap features of MDP::actionValueIteration; leaves are
+    // boards whose lines are already cleared, so the line and score
+    // features would always be 0 there. Both are offset by their worst
+    // value, so that with non-negative weights any living leaf is worth
+    // more than game over (0).
+    static LeafEvaluator featureEvaluator(double height_weight,
+                                          double gap_reduction);
+};
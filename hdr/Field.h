@@ -1,38 +1,53 @@
 #pragma once
 
+#include "Arena.h"
 #include "Point.h"
 #include "Tromino.h"
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <ostream>
 
+#define MAX_FIELD_WIDTH 64
+
 class Field
 {
+  public:
+    // one word per line, bit c is column c; allocated from Arena::current()
+    // when the Field is built
+    using Rows = std::pmr::vector<uint64_t>;
+
   private:
     int width_;
     int height_;
-    std::vector<std::vector<bool>> grid_;
+    Rows rows_;
 
   public:
     // constructors
-    Field(int width, int height) : width_(width), height_(height)
-    {
-        grid_.assign(height_, std::vector<bool>(width_, false));
-    };
-    Field(std::vector<std::vector<bool>> g)
-        : width_(g[0].size()), height_(g.size()), grid_(g) {};
+    Field(int width, int height);
 
     // getters
     int getWidth() const { return width_; };
     int getHeight() const { return height_; };
-    std::vector<std::vector<bool>> getGrid() const { return grid_; };
+    uint64_t getRow(int line) const { return rows_[line]; };
+    uint64_t fullRow() const { return ~0ULL >> (64 - width_); };
+    bool isFilled(int line, int column) const
+    {
+        return (rows_[line] >> column) & 1ULL;
+    };
 
     // other methods
+    void setRow(int line, uint64_t bits) { rows_[line] = bits; };
     bool isAvailable(int line, int column) const;
     bool isAvailable(const Tromino& t, int line, int column, int rotation) const;
     bool addTromino(const Tromino& t, int line, int column, int rotation);
-    void setGrid(const std::vector<std::vector<bool>>& g) { grid_ = g; }
+    // removes the complete lines and returns how many there were
+    int clearLines();
+    int nbFullLines() const;
     std::vector<Point> getEmptyPositions() const;
+    int getMaxHeight() const;
+    int getColumnHeight(int column) const;
     Field clone() const;
+    bool operator==(const Field& other) const { return rows_ == other.rows_; };
     friend std::ostream& operator<<(std::ostream& os, const Field& f);
 };
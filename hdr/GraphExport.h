@@ -0,0 +1,53 @@
+#pragma once
+
+#include "StateGraph.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define NPY_CHUNK 65536 // elements gathered per write for strided fields
+
+// One .npy array (format 1.0, little-endian, C order) written as it comes:
+// the header first, then the elements, so nothing is copied whole.
+class NpyWriter
+{
+  private:
+    std::string path_;
+    std::ofstream out_;
+    size_t expected_;
+    size_t written_;
+    bool closed_;
+
+    void writeBytes(const void* data, size_t count, size_t size);
+
+  public:
+    // descr is the numpy type string, "<u8", "<i4", "<f8", "|u1"...
+    NpyWriter(const std::string& path,
+              const std::string& descr,
+              const std::vector<size_t>& shape);
+    // flushes the file and checks that the whole shape was written,
+    // ERROR and exit(1) otherwise
+    void close();
+    // a writer left open, e.g. while unwinding, only warns about a short
+    // file
+    ~NpyWriter();
+
+    NpyWriter(const NpyWriter&) = delete;
+    NpyWriter& operator=(const NpyWriter&) = delete;
+
+    template <typename T> void write(const T* data, size_t count)
+    {
+        writeBytes(data, count, sizeof(T));
+    }
+};
+
+// Writes the graph to directory as .npy arrays for external solvers:
+//   meta            int32 [width, height, nbPieces]
+//   keys            uint64 [states], State::key() of every id
+//   action_offsets  int32 [states + 1], CSR offsets into the actions
+//   actions         int8 [actions, 3], line, column and rotation
+//   next            int32 [actions, pieces], successor ids
+//   probabilities   float64 [actions, pieces], probability of the piece
+//   lines, height, score, gaps  uint8 [actions, pieces], reward features
+void exportGraph(const StateGraph& graph, const std::string& directory);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Player.h"
+#include <string>
+#include <vector>
+
+// Value function approximated as a weighted sum of board features:
+// a constant, the height of every column, the bumpiness (sum of the height
+// differences of adjacent columns), the holes and the maximum height.
+class LinearValue
+{
+  private:
+    std::vector<double> weights_;
+
+  public:
+    LinearValue(int width) : weights_(nbFeatures(width), 0.0) {};
+    LinearValue(std::vector<double> weights) : weights_(std::move(weights)) {};
+
+    static int nbFeatures(int width) { return width + 4; };
+    static std::vector<double> features(const State& state);
+
+    const std::vector<double>& getWeights() const { return weights_; };
+    void setWeights(std::vector<double> weights) { weights_ = std::move(weights); };
+
+    double value(const State& state) const;
+    // the value as a leaf evaluator for Expectimax and MCTS
+    LeafEvaluator evaluator() const;
+
+    // plain text, one weight per line
+    void save(const std::string& path) const;
+    static LinearValue load(const std::string& path);
+};
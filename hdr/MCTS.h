@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Player.h"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Monte Carlo Tree Search player. Decision nodes pick an action by UCT,
+// the next piece is a chance node sampled from the PieceSet and new leaves
+// are valued by a playout. Each thread grows its own tree from the root
+// (root parallelisation) and the visit counts of the roots are summed.
+class MCTS : public Player
+{
+  private:
+    struct Node
+    {
+        State state;
+        std::vector<Action> actions;
+        std::vector<double> rewards; // score of placing each action
+        std::vector<double> values;  // sum of the returns of each action
+        std::vector<int> visits;
+        std::vector<int32_t> children; // per action and piece, -1 if unseen
+        int totalVisits;
+
+        Node(State s);
+    };
+
+    int nbThreads_;
+    int iterations_;    // per thread and per move
+    double timeBudget_; // in milliseconds, <= 0 for iterations only
+    double exploration_;
+    double lambda_;
+    int playoutDepth_;
+    LeafEvaluator heuristic_; // greedy playouts if set, random otherwise
+    long lastIterations_;
+
+    std::vector<int> searchTree(const State& root, uint32_t seed) const;
+    int selectAction(const Node& node) const;
+    double playout(State state, std::mt19937& rng) const;
+    int drawPiece(std::mt19937& rng) const;
+
+  public:
+    MCTS(int nbThreads,
+         int iterations,
+         double timeBudget,
+         double exploration,
+         double lambda,
+         int playoutDepth,
+         LeafEvaluator heuristic);
+
+    Action chooseAction(const State& state) override;
+
+    // iterations of the last chooseAction, over all the threads
+    long getLastIterations() const { return lastIterations_; };
+};
@@ -1,6 +1,13 @@
 #pragma once
 
+#include "Bellman.h"
+#include "Checkpoint.h"
+#include "CompactPolicy.h"
+#include "CompiledPolicy.h"
 #include "Game.h"
+#include "LinearValue.h"
+#include "Player.h"
+#include "StateGraph.h"
 #include <algorithm>
 #include <cstddef>
 #include <float.h>
@@ -8,12 +15,46 @@
 #include <memory>
 #include <numeric>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #define MAX_ACTION 10000
 #define DEBUG 0
+// longest cycle of the value increments finiteHorizonIteration looks for
+#define FINITE_HORIZON_MAX_PERIOD 4
+
+// Solution of the zero-sum game between the player and the adversary
+struct GameSolution
+{
+    std::unordered_map<State, Action> actions;
+    std::unordered_map<State, std::unique_ptr<Tromino>> trominos;
+    double value; // guaranteed discounted score from s0
+};
+
+// The three deterministic adversaries, solved together
+struct AdversarySolution
+{
+    std::unordered_map<State, std::unique_ptr<Tromino>> minMax;
+    std::unordered_map<State, std::unique_ptr<Tromino>> minAvg;
+    std::unordered_map<State, std::unique_ptr<Tromino>> gapAvg;
+};
+
+// Optimal play for a fixed number of moves, as the games are evaluated
+struct FiniteHorizonSolution
+{
+    // greedy policy of the last backward step, for the moves before the tail
+    std::unordered_map<State, Action> policy;
+    // tail[k] is the policy to play with k + 1 moves left
+    std::vector<CompactPolicy> tail;
+    double value; // best expected total reward from s0 over the horizon
+    int steps;    // backward steps computed before the layers stabilized
+    // bound on |value - exact value|: 0 when all the steps ran, else
+    // epsilon per extrapolated step
+    double error;
+};
 
 class MDP
 {
@@ -21,10 +62,14 @@ class MDP
     int width_;
     int height_;
     State s0_;
+    std::shared_ptr<const StateGraph> graph_;
+    std::string checkpointPath_;
+    int checkpointPeriod_;
 
   public:
     MDP(int width, int height, State s0)
-        : width_(width), height_(height), s0_(std::move(s0)) {};
+        : width_(width), height_(height), s0_(std::move(s0)),
+          checkpointPeriod_(0) {};
     ~MDP() = default;
 
     std::unordered_map<State, Action> actionValueIteration(double lambda,
@@ -35,9 +80,90 @@ class MDP
                                                            double epsilon,
                                                            int maxIteration);
 
+    // actionValueIteration saves V, its policy, the iteration and the delta
+    // to path every `period` sweeps and after the last one (0 disables)
+    void setCheckpoint(const std::string& path, int period)
+    {
+        checkpointPath_ = path;
+        checkpointPeriod_ = period;
+    };
+
+    // continues the actionValueIteration saved in path, with the same
+    // parameters, up to maxIteration sweeps in total
+    std::unordered_map<State, Action>
+    resumeActionValueIteration(const std::string& path,
+                               double lambda,
+                               double line_weight,
+                               double height_weight,
+                               double score_weight,
+                               double gap_reduction,
+                               double epsilon,
+                               int maxIteration);
+
+    // same objective on the state graph with Jacobi sweeps, extrapolated by
+    // Anderson acceleration over the last `memory` iterates (0 disables it)
+    std::unordered_map<State, Action>
+    acceleratedActionValueIteration(double lambda,
+                                    double line_weight,
+                                    double height_weight,
+                                    double score_weight,
+                                    double gap_reduction,
+                                    double epsilon,
+                                    int maxIteration,
+                                    int memory);
+
+    // undiscounted objective over exactly horizon moves by backward
+    // induction on the state graph with two value layers. Stops early once
+    // the increments of the values repeat (within epsilon) with a period of
+    // at most FINITE_HORIZON_MAX_PERIOD steps and extrapolates the cycle
+    // over the remaining steps: the value is then exact only up to epsilon
+    // per extrapolated step, provided the increments stay that close to
+    // the cycle. The policy of the last tailLength moves is kept step by
+    // step.
+    FiniteHorizonSolution finiteHorizonIteration(double line_weight,
+                                                 double height_weight,
+                                                 double score_weight,
+                                                 double gap_reduction,
+                                                 int horizon,
+                                                 double epsilon,
+                                                 int tailLength);
+
+    // approximate solve of the same objective without enumeration: V is a
+    // LinearValue refitted by least squares on batches of states visited by
+    // its own epsilon-greedy policy
+    LinearValue fittedValueIteration(double lambda,
+                                     double line_weight,
+                                     double height_weight,
+                                     double score_weight,
+                                     double gap_reduction,
+                                     int nbIterations,
+                                     int batchSize,
+                                     double exploration);
+
+    // same objective solved only on the states the optimal policy reaches
+    // from s0: labeled RTDP expands states lazily from an upper bound of
+    // their value and stops once s0 and its variants with every first piece
+    // are solved, or after maxTrials trials
+    std::unordered_map<State, Action> heuristicSearch(double lambda,
+                                                      double line_weight,
+                                                      double height_weight,
+                                                      double score_weight,
+                                                      double gap_reduction,
+                                                      double epsilon,
+                                                      int maxTrials);
+
     std::unordered_map<State, Action> robustActionValueIterationMaxMin(
         double epsilon, int maxIteration, double lambda);
 
+    // the max-min objective of robustActionValueIterationMaxMin, swept in
+    // place in state graph order instead of hash map order. Both keep the
+    // first action on exact ties, but their values stop at different
+    // points within epsilon, so where actions tie at the fixed point they
+    // may keep different ones (50 of the 25956 4x4 states, a gap of 7e-9)
+    GameSolution gameValueIteration(double epsilon,
+                                    int maxIteration,
+                                    double lambda);
+
     std::unordered_map<State, std::unique_ptr<Tromino>>
     trominoValueIterationMinMax(double epsilon,
                                 int maxIteration,
@@ -53,15 +179,68 @@ class MDP
                                 int maxIteration,
                                 double lambda);
 
+    // the three solvers above in one traversal of the state graph: moves
+    // and successors are shared, the states are split between nbThreads
+    // workers started once for all the sweeps
+    AdversarySolution adversaryValueIteration(double epsilon,
+                                              int maxIteration,
+                                              double lambda,
+                                              int nbThreads);
+
     std::unordered_map<State, double> generateReachableStates(State s0);
 
+    // reachable graph from s0_, explored on first use and shared afterwards
+    const StateGraph& getGraph();
+    std::shared_ptr<const StateGraph> getSharedGraph();
+    void setGraph(std::shared_ptr<const StateGraph> graph) { graph_ = graph; };
+
     int playPolicy(
         Game& game,
         const std::unordered_map<State, Action>& policy,
         const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy);
 
-    void prettyPrint(State& curr, State placed, State after);
+    int playPolicy(
+        Game& game,
+        Player& player,
+        const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy);
+
+    CompiledPolicy compilePolicy(const std::unordered_map<State, Action>& policy);
+    std::vector<int8_t> compileAdversary(
+        const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy);
+    // one byte per state id, for storing and diffing policies
+    CompactPolicy compactPolicy(const std::unordered_map<State, Action>& policy);
+    CompactAdversary compactAdversary(
+        const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy);
+
+    static void prettyPrint(State& curr, State placed, State after);
 
   private:
     int getMaxHeight(const Field& field) const;
+
+    std::unordered_map<State, Action>
+    runActionValueIteration(std::unordered_map<State, double>& V,
+                            std::unordered_map<State, Action>& A,
+                            int firstIteration,
+                            double lambda,
+                            double line_weight,
+                            double height_weight,
+                            double score_weight,
+                            double gap_reduction,
+                            double epsilon,
+                            int maxIteration);
+    Checkpoint snapshot(const std::unordered_map<State, double>& V,
+                        const std::unordered_map<State, Action>& A,
+                        int iteration,
+                        double delta) const;
+
+    std::vector<double> transitionRewards(const StateGraph& graph,
+                                          double line_weight,
+                                          double height_weight,
+                                          double score_weight,
+                                          double gap_reduction) const;
+    // probability of the piece times lambda, for each transition
+    std::vector<double> transitionCoefficients(const StateGraph& graph,
+                                               double lambda) const;
+    std::unordered_map<State, Action>
+    toActionMap(const StateGraph& graph, const std::vector<int>& policy) const;
 };
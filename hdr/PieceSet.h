@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#define PROBA_I_PIECE 0.5
+
+using Offset = std::array<int, 2>;
+
+// Cells covered by a piece for each of its rotations, as (line, column)
+// offsets from the anchor of the action
+struct PieceShape
+{
+    std::string name;
+    std::vector<std::vector<Offset>> rotations;
+};
+
+// The pieces the game can draw with their probabilities. The active set is
+// global and has to be chosen before any State is built.
+class PieceSet
+{
+  private:
+    std::vector<PieceShape> shapes_;
+    std::vector<double> probabilities_;
+
+  public:
+    PieceSet(std::vector<PieceShape> shapes, std::vector<double> probabilities);
+
+    int size() const { return shapes_.size(); };
+    const PieceShape& getShape(int piece) const { return shapes_[piece]; };
+    double getProbability(int piece) const { return probabilities_[piece]; };
+    const std::vector<double>& getProbabilities() const
+    {
+        return probabilities_;
+    };
+    // random piece index following the probability vector
+    int draw() const;
+
+    // I and L trominoes (baby Tetris), the default set
+    static PieceSet trominoes();
+    // the 7 tetrominoes drawn uniformly
+    static PieceSet tetrominoes();
+
+    static const PieceSet& get();
+    static void set(PieceSet pieces);
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "State.h"
+#include <functional>
+
+// Heuristic value of a state where a search or a playout stops
+using LeafEvaluator = std::function<double(const State&)>;
+
+// Anything able to pick the action to play in a state, so that solved
+// policies and online searches share the MDP::playPolicy game loop
+class Player
+{
+  public:
+    virtual ~Player() = default;
+    virtual Action chooseAction(const State& state) = 0;
+};
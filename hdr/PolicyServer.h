@@ -0,0 +1,127 @@
+#pragma once
+
+#include "CompactPolicy.h"
+#include "StateGraph.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define NO_ANSWER_ACTION -1 // rotation answered for a terminal state
+#define UNKNOWN_STATE -2    // rotation answered for a key not in the table
+#define MAX_QUERY_BATCH 65536
+// bytes of answers queued for a client before its requests wait
+#define MAX_PENDING_OUTPUT (4 * MAX_QUERY_BATCH * sizeof(PolicyAnswer))
+
+// Answer to one query: the action of the policy and the piece the
+// adversary gives in that state (RANDOM_PIECE where it has no choice)
+struct PolicyAnswer
+{
+    int8_t line;
+    int8_t column;
+    int8_t rotation;
+    int8_t piece;
+};
+
+// Policy and adversary of every state of a graph, sorted by State::key()
+// so that the file can be mapped and searched as is.
+void writePolicyTable(const std::string& path,
+                      const StateGraph& graph,
+                      const CompactPolicy& policy,
+                      const std::vector<int8_t>& adversary);
+
+class PolicyTable
+{
+  private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        int32_t nbPieces;
+        uint32_t padding;
+        uint64_t nbStates;
+    };
+
+    void* data_;
+    size_t bytes_;
+    const Header* header_;
+    const uint64_t* keys_;
+    const PolicyAnswer* answers_;
+
+    friend void writePolicyTable(const std::string& path,
+                                 const StateGraph& graph,
+                                 const CompactPolicy& policy,
+                                 const std::vector<int8_t>& adversary);
+
+  public:
+    // maps the file read-only, pages are loaded on first query
+    explicit PolicyTable(const std::string& path);
+    ~PolicyTable();
+    PolicyTable(const PolicyTable&) = delete;
+    PolicyTable& operator=(const PolicyTable&) = delete;
+
+    int getWidth() const { return header_->width; };
+    int getHeight() const { return header_->height; };
+    int getNbPieces() const { return header_->nbPieces; };
+    size_t size() const { return header_->nbStates; };
+    PolicyAnswer query(uint64_t key) const;
+};
+
+// Answers queries on a Unix domain socket from a single poll loop. A request
+// is a uint32 count followed by count uint64 keys, the response count
+// PolicyAnswer of 4 bytes. A count of 0 asks for the width, height, number
+// of pieces and number of states as four int32. Every wake-up serves the
+// requests of all the clients that are ready. A client is not read from
+// while MAX_PENDING_OUTPUT bytes of answers wait for it.
+class PolicyServer
+{
+  private:
+    struct Client
+    {
+        int fd;
+        std::vector<char> in;
+        std::vector<char> out;
+    };
+
+    const PolicyTable& table_;
+    std::string path_;
+    int listen_;
+    int wake_[2]; // stop() writes to wake_[1]
+    std::vector<Client> clients_;
+
+    // answers the complete requests of in until out is full, false on a
+    // malformed one
+    bool answer(Client& client);
+
+  public:
+    PolicyServer(const PolicyTable& table, const std::string& socketPath);
+    ~PolicyServer();
+    PolicyServer(const PolicyServer&) = delete;
+    PolicyServer& operator=(const PolicyServer&) = delete;
+
+    // serves until stop()
+    void run();
+    // can be called from another thread or a signal handler
+    void stop();
+};
+
+// Blocking connection to a PolicyServer
+class PolicyClient
+{
+  private:
+    int fd_;
+
+    void send(const void* data, size_t bytes);
+    void receive(void* data, size_t bytes);
+
+  public:
+    explicit PolicyClient(const std::string& socketPath);
+    ~PolicyClient();
+    PolicyClient(const PolicyClient&) = delete;
+    PolicyClient& operator=(const PolicyClient&) = delete;
+
+    std::vector<PolicyAnswer> query(const std::vector<uint64_t>& keys);
+    // width, height, number of pieces and number of states of the table
+    std::vector<int32_t> info();
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+// Hot-path instrumentation, compiled in with `make PROFILE=1` only. Each
+// thread counts calls, cycles and allocations in its own table; tables are
+// merged when threads exit and the report is printed on stderr at exit.
+//
+//   PROFILE_SCOPE(PROF_COMPLETE_LINES); // times the rest of the block
+//   PROFILE_COUNT(PROF_MAP_LOOKUP);     // counts a call, no timer
+
+enum ProfilePoint
+{
+    PROF_AVAILABLE_ACTIONS,
+    PROF_GEN_ALL_STATES,
+    PROF_COMPLETE_LINES,
+    PROF_STATE_CLONE,
+    PROF_STATE_HASH,
+    PROF_MAP_LOOKUP,
+    PROF_GRAPH_BUILD,
+    PROF_GRAPH_EXPAND,
+    PROF_SWEEP,
+    PROF_POLICY_EVAL,
+    PROF_NB_POINTS
+};
+
+namespace profiler
+{
+uint64_t cycles();
+uint64_t allocations();
+void record(ProfilePoint point, uint64_t cycles, uint64_t allocations);
+void count(ProfilePoint point);
+// calls of point recorded by the calling thread so far
+uint64_t calls(ProfilePoint point);
+
+class Scope
+{
+  private:
+    ProfilePoint point_;
+    uint64_t start_;
+    uint64_t allocations_;
+
+  public:
+    explicit Scope(ProfilePoint point)
+        : point_(point), start_(cycles()), allocations_(allocations()) {};
+    ~Scope()
+    {
+        record(point_, cycles() - start_, allocations() - allocations_);
+    };
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+} // namespace profiler
+
+#ifdef PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(point)                                                   \
+    profiler::Scope PROFILE_CONCAT(profileScope_, __LINE__)(point)
+#define PROFILE_COUNT(point) profiler::count(point)
+#else
+#define PROFILE_SCOPE(point)                                                   \
+    do                                                                         \
+    {                                                                          \
+    } while (0)
+#define PROFILE_COUNT(point)                                                   \
+    do                                                                         \
+    {                                                                          \
+    } while (0)
+#endif
@@ -5,16 +5,17 @@
 #include "Tromino.h"
 #include <algorithm>
 #include <array>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <vector>
 
-#define PROBA_I_PIECE 0.5
 #define SCORE_1_LINE 1
 #define SCORE_2_LINES 3
 #define SCORE_3_LINES 6
+#define SCORE_4_LINES 10
 
 class State
 {
@@ -53,11 +54,17 @@ class State
     int evaluate() const;
     int nbCompleteLines() const;
     State completeLines() const;
+    // same, also gives the number of lines removed
+    State completeLines(int& nbLines) const;
     int gapCheck() const;
 
     bool operator==(const State& other) const;
     size_t hash() const;
 
+    // packed board bits and next piece, the inverse of fromKey
+    uint64_t key() const;
+    static State fromKey(uint64_t key, int width, int height);
+
     friend std::ostream& operator<<(std::ostream& os, const State& s);
 };
 
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "State.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Outcome of playing one action when the given piece comes next. The
+// features are the ones of the placed state (before line completion) that
+// the solvers use as immediate rewards.
+struct Transition
+{
+    int32_t next; // id of the state reached after line completion
+    uint8_t lines;
+    uint8_t height;
+    uint8_t score;
+    uint8_t gaps;
+};
+
+// How renumber() orders the states: breadth-first from the roots (the
+// order of construction), reverse Cuthill-McKee on the undirected graph, or
+// by stack height then breadth-first.
+enum StateOrder
+{
+    ORDER_BFS,
+    ORDER_RCM,
+    ORDER_HEIGHT
+};
+
+// Reachable state space of an MDP stored as flat arrays indexed by state id.
+// The actions of state s are actions_[actionOffsets_[s] .. actionOffsets_[s+1]]
+// and action k owns one transition per piece of the PieceSet, starting at
+// k * getNbPieces().
+class StateGraph
+{
+  private:
+    int width_;
+    int height_;
+    int nbPieces_;
+    std::vector<uint64_t> keys_;
+    std::unordered_map<uint64_t, int32_t> ids_;
+    std::vector<int32_t> actionOffsets_;
+    std::vector<Action> actions_;
+    std::vector<Transition> transitions_;
+    std::vector<uint64_t> roots_;
+
+  public:
+    // level-synchronous BFS from s0 and s0 with every piece of the active set
+    StateGraph(const State& s0, int nbThreads);
+
+    int getWidth() const { return width_; };
+    int getHeight() const { return height_; };
+    int getNbPieces() const { return nbPieces_; };
+    int size() const { return keys_.size(); };
+    size_t nbActions() const { return actions_.size(); };
+
+    uint64_t getKey(int id) const { return keys_[id]; };
+    State getState(int id) const;
+    // -1 if the key is not reachable
+    int find(uint64_t key) const;
+
+    int actionBegin(int id) const { return actionOffsets_[id]; };
+    int actionEnd(int id) const { return actionOffsets_[id + 1]; };
+    const Action& getAction(int k) const { return actions_[k]; };
+    const Transition& getTransition(int k, int piece) const
+    {
+        return transitions_[(size_t)k * nbPieces_ + piece];
+    };
+
+    const std::vector<uint64_t>& getKeys() const { return keys_; };
+    const std::vector<int32_t>& getActionOffsets() const
+    {
+        return actionOffsets_;
+    };
+    const std::vector<Action>& getActions() const { return actions_; };
+    const std::vector<Transition>& getTransitions() const
+    {
+        return transitions_;
+    };
+
+    // order[i] is the current id of the state that gets id i
+    std::vector<int32_t> ordering(StateOrder order) const;
+    // Gives the states new ids so that successors sit close to their
+    // predecessors in memory. Ids handed out before are invalidated, keys
+    // stay valid.
+    void renumber(const std::vector<int32_t>& order);
+    void renumber(StateOrder order) { renumber(ordering(order)); };
+};
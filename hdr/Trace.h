@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Action.h"
+#include "State.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define TRACE_RING_SIZE 65536 // records buffered per thread
+
+// One move of a traced game, 16 bytes on disk
+struct TraceRecord
+{
+    uint64_t key;          // State::key() before the move
+    uint32_t game;         // unique over the whole trace
+    int8_t line;           // action
+    int8_t column;
+    uint8_t rotationPiece; // rotation in the low nibble, next piece above
+    uint8_t gain;          // score of the move
+};
+
+// Binary trace of played games. Each thread appends to its own ring
+// buffer without locking, a background thread drains the rings to the
+// file. Recording a move is a key computation and a copy into the ring.
+class TraceRecorder
+{
+  public:
+    // starts tracing to path, boards of the given size
+    static void open(const std::string& path, int width, int height);
+    // drains every ring and closes the file
+    static void close();
+    static bool enabled();
+
+    // id of a new game, to pass to record()
+    static uint32_t beginGame();
+    static void record(uint32_t game,
+                       const State& before,
+                       const Action& action,
+                       int piece,
+                       int gain);
+};
+
+struct TraceFile
+{
+    int width;
+    int height;
+    std::vector<TraceRecord> records;
+};
+TraceFile readTrace(const std::string& path);
+
+// Without game, lists the games of a trace with their length and score;
+// with one, shows its moves with MDP::prettyPrint
+void replayTrace(const std::string& path);
+void replayTrace(const std::string& path, uint32_t game);
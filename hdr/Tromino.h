@@ -1,44 +1,34 @@
 #pragma once
 
-#include <array>
+#include "PieceSet.h"
 #include <memory>
 #include <ostream>
 #include <vector>
 
-using Offset = std::array<int, 2>;
+#define I_PIECE 0
+#define L_PIECE 1
 
+// A piece of the active PieceSet, identified by its index in the set
 class Tromino
 {
-  public:
-    virtual ~Tromino() = default;
-    virtual std::vector<Offset> getOffsets(int rotation) const = 0;
-    virtual int rotationCount() const { return 4; }
-    virtual void print(std::ostream& os) const = 0; // pure virtual print method
-    virtual bool isIPiece() const { return false; }
-    virtual bool isLPiece() const { return false; }
-    // Return a heap-allocated copy of this tromino
-    virtual std::unique_ptr<Tromino> clone() const = 0;
-};
+  private:
+    int type_;
 
-// Declare operator<< for Tromino
-std::ostream& operator<<(std::ostream& os, const Tromino& piece);
-
-class IPiece : public Tromino
-{
   public:
-    int rotationCount() const override { return 2; };
-    std::vector<Offset> getOffsets(int rotation) const override;
-    void print(std::ostream& os) const override;
-    std::unique_ptr<Tromino> clone() const;
-    bool isIPiece() const override { return true; }
-};
+    explicit Tromino(int type) : type_(type) {};
 
-class LPiece : public Tromino
-{
-  public:
-    int rotationCount() const override { return 4; };
-    std::vector<Offset> getOffsets(int rotation) const override;
-    void print(std::ostream& os) const override;
+    int getType() const { return type_; };
+    const std::vector<Offset>& getOffsets(int rotation) const;
+    int rotationCount() const;
+    void print(std::ostream& os) const;
+    // Return a heap-allocated copy of this tromino
     std::unique_ptr<Tromino> clone() const;
-    bool isLPiece() const override { return true; }
+
+    // pieces come from per-thread lists of fixed-size blocks instead of
+    // the general heap, every State owns one; the blocks of a list that
+    // grows too long or of an exiting thread are shared with the others
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
 };
+
+std::ostream& operator<<(std::ostream& os, const Tromino& piece);
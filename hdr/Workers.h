@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// below this many items per thread, work is not worth splitting
+#define MIN_STATES_PER_THREAD 64
+
+// run job(w) for w in [0, nbWorkers), the last one on the calling thread
+template <typename Job> void runWorkers(int nbWorkers, Job job)
+{
+    std::vector<std::thread> workers;
+    for (int w = 0; w < nbWorkers - 1; w++)
+    {
+        workers.emplace_back(job, w);
+    }
+    job(nbWorkers - 1);
+    for (std::thread& t : workers)
+    {
+        t.join();
+    }
+}
+
+// runWorkers for loops that dispatch every iteration: the threads are
+// started once and wait between runs, the last worker is the calling thread
+class WorkerPool
+{
+  private:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable start_, done_;
+    const std::function<void(int)>* job_ = nullptr;
+    uint64_t generation_ = 0;
+    int running_ = 0;
+    bool stop_ = false;
+
+    void loop(int w)
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            const std::function<void(int)>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_.wait(lock,
+                            [&] { return stop_ || generation_ != seen; });
+                if (stop_)
+                {
+                    return;
+                }
+                seen = generation_;
+                job = job_;
+            }
+            (*job)(w);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--running_ == 0)
+            {
+                done_.notify_one();
+            }
+        }
+    }
+
+  public:
+    explicit WorkerPool(int nbWorkers)
+    {
+        for (int w = 0; w < nbWorkers - 1; w++)
+        {
+            threads_.emplace_back(&WorkerPool::loop, this, w);
+        }
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        start_.notify_all();
+        for (std::thread& t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    int size() const { return (int)threads_.size() + 1; };
+
+    // job(w) for w in [0, size()), returns once every worker is done
+    void run(const std::function<void(int)>& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            running_ = (int)threads_.size();
+            generation_++;
+        }
+        start_.notify_all();
+        job((int)threads_.size());
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return running_ == 0; });
+    }
+};
+
+inline int workersFor(size_t items, int nbThreads)
+{
+    size_t wanted = items / MIN_STATES_PER_THREAD;
+    return (int)std::max<size_t>(1, std::min<size_t>(nbThreads, wanted));
+}
@@ -0,0 +1,72 @@
+#include "Arena.h"
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+thread_local std::pmr::memory_resource* t_current = nullptr;
+}
+
+Arena::~Arena()
+{
+    for (char* chunk : chunks_)
+    {
+        std::free(chunk);
+    }
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment)
+{
+    if (bytes > ARENA_CHUNK_SIZE)
+    {
+        // never happens for a board, not worth a special chunk size
+        throw std::bad_alloc();
+    }
+
+    while (true)
+    {
+        if (chunk_ == chunks_.size())
+        {
+            char* chunk = static_cast<char*>(std::malloc(ARENA_CHUNK_SIZE));
+            if (!chunk)
+            {
+                throw std::bad_alloc();
+            }
+            chunks_.push_back(chunk);
+        }
+
+        size_t start = (offset_ + alignment - 1) & ~(alignment - 1);
+        if (start + bytes <= ARENA_CHUNK_SIZE)
+        {
+            offset_ = start + bytes;
+            return chunks_[chunk_] + start;
+        }
+        chunk_++;
+        offset_ = 0;
+    }
+}
+
+std::pmr::memory_resource* Arena::current()
+{
+    return t_current ? t_current : std::pmr::new_delete_resource();
+}
+
+Arena& Arena::local()
+{
+    thread_local Arena arena;
+    return arena;
+}
+
+Arena::Scope::Scope(Arena& arena)
+    : arena_(arena), previous_(t_current), chunk_(arena.chunk_),
+      offset_(arena.offset_)
+{
+    t_current = &arena_;
+}
+
+Arena::Scope::~Scope()
+{
+    arena_.chunk_ = chunk_;
+    arena_.offset_ = offset_;
+    t_current = previous_;
+}
@@ -0,0 +1,209 @@
+#include "Bellman.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// states whose transitions are valued in one kernel call by the Jacobi sweep
+#define BELLMAN_BLOCK 512
+
+namespace
+{
+void transitionsScalar(const int32_t* next,
+                       const double* reward,
+                       const double* coef,
+                       const double* V,
+                       size_t n,
+                       double* out)
+{
+    for (size_t t = 0; t < n; t++)
+    {
+        out[t] = reward[t] + coef[t] * V[next[t]];
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) void transitionsAvx2(const int32_t* next,
+                                                     const double* reward,
+                                                     const double* coef,
+                                                     const double* V,
+                                                     size_t n,
+                                                     double* out)
+{
+    size_t t = 0;
+    for (; t + 4 <= n; t += 4)
+    {
+        __m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i*>(next + t));
+        // the masked form, the plain one trips -Wmaybe-uninitialized
+        __m256d v = _mm256_mask_i32gather_pd(
+            _mm256_setzero_pd(), V, ids,
+            _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+        __m256d product = _mm256_mul_pd(_mm256_loadu_pd(coef + t), v);
+        _mm256_storeu_pd(out + t,
+                         _mm256_add_pd(_mm256_loadu_pd(reward + t), product));
+    }
+    transitionsScalar(next + t, reward + t, coef + t, V, n - t, out + t);
+}
+
+__attribute__((target("avx512f"))) void transitionsAvx512(const int32_t* next,
+                                                          const double* reward,
+                                                          const double* coef,
+                                                          const double* V,
+                                                          size_t n,
+                                                          double* out)
+{
+    size_t t = 0;
+    for (; t + 8 <= n; t += 8)
+    {
+        __m256i ids =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(next + t));
+        __m512d v = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, ids, V, 8);
+        __m512d product = _mm512_mul_pd(_mm512_loadu_pd(coef + t), v);
+        _mm512_storeu_pd(out + t,
+                         _mm512_add_pd(_mm512_loadu_pd(reward + t), product));
+    }
+    transitionsScalar(next + t, reward + t, coef + t, V, n - t, out + t);
+}
+#endif
+} // namespace
+
+const std::vector<BellmanBackup::Kernel>& BellmanBackup::kernels()
+{
+    static const std::vector<Kernel> available = []
+    {
+        std::vector<Kernel> k;
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            k.push_back({"avx512", transitionsAvx512});
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            k.push_back({"avx2", transitionsAvx2});
+        }
+#endif
+        k.push_back({"scalar", transitionsScalar});
+        return k;
+    }();
+    return available;
+}
+
+BellmanBackup::BellmanBackup(const StateGraph& graph,
+                             std::vector<double> reward,
+                             std::vector<double> coef)
+    : graph_(graph), next_(graph.getTransitions().size()),
+      reward_(std::move(reward)), coef_(std::move(coef)),
+      kernel_(kernels().front().run)
+{
+    const std::vector<Transition>& transitions = graph.getTransitions();
+    for (size_t t = 0; t < transitions.size(); t++)
+    {
+        next_[t] = transitions[t].next;
+    }
+}
+
+double BellmanBackup::expectationMax(const std::vector<double>& V,
+                                     std::vector<double>& VOut,
+                                     std::vector<int>* policy) const
+{
+    PROFILE_SCOPE(PROF_SWEEP);
+    int nbPieces = graph_.getNbPieces();
+    int nbStates = graph_.size();
+    std::vector<double> values;
+    double delta = 0.0;
+
+    for (int first = 0; first < nbStates; first += BELLMAN_BLOCK)
+    {
+        int last = std::min(nbStates, first + BELLMAN_BLOCK);
+        size_t begin = (size_t)graph_.actionBegin(first) * nbPieces;
+        size_t end = (size_t)graph_.actionBegin(last) * nbPieces;
+        values.resize(end - begin);
+        kernel_(&next_[begin], &reward_[begin], &coef_[begin], V.data(),
+                end - begin, values.data());
+
+        for (int s = first; s < last; s++)
+        {
+            if (graph_.actionBegin(s) == graph_.actionEnd(s))
+            {
+                VOut[s] = V[s];
+                continue;
+            }
+
+            double vPrime = -DBL_MAX;
+            for (int k = graph_.actionBegin(s); k < graph_.actionEnd(s); k++)
+            {
+                const double* q = &values[(size_t)k * nbPieces - begin];
+                double sum = 0.0;
+                for (int p = 0; p < nbPieces; p++)
+                {
+                    sum += q[p];
+                }
+                if (sum > vPrime)
+                {
+                    vPrime = sum;
+                    if (policy)
+                    {
+                        (*policy)[s] = k;
+                    }
+                }
+            }
+            delta = std::max(delta, std::abs(vPrime - V[s]));
+            VOut[s] = vPrime;
+        }
+    }
+    return delta;
+}
+
+double BellmanBackup::minMax(std::vector<double>& V,
+                             std::vector<int>& bestAction,
+                             std::vector<int>& worstPiece) const
+{
+    PROFILE_SCOPE(PROF_SWEEP);
+    int nbPieces = graph_.getNbPieces();
+    std::vector<double> values;
+    double delta = 0.0;
+
+    for (int s = 0; s < graph_.size(); s++)
+    {
+        if (graph_.actionBegin(s) == graph_.actionEnd(s))
+        {
+            continue;
+        }
+
+        // in place: the successors of s see the values already updated
+        size_t begin = (size_t)graph_.actionBegin(s) * nbPieces;
+        size_t end = (size_t)graph_.actionEnd(s) * nbPieces;
+        values.resize(end - begin);
+        kernel_(&next_[begin], &reward_[begin], &coef_[begin], V.data(),
+                end - begin, values.data());
+
+        double vPrime = -DBL_MAX;
+        for (int k = graph_.actionBegin(s); k < graph_.actionEnd(s); k++)
+        {
+            const double* q = &values[(size_t)k * nbPieces - begin];
+            double minReward = DBL_MAX;
+            int minPiece = 0;
+            for (int p = 0; p < nbPieces; p++)
+            {
+                if (q[p] < minReward)
+                {
+                    minReward = q[p];
+                    minPiece = p;
+                }
+            }
+            if (minReward > vPrime)
+            {
+                vPrime = minReward;
+                bestAction[s] = k;
+                worstPiece[s] = minPiece;
+            }
+        }
+        delta = std::max(delta, std::abs(vPrime - V[s]));
+        V[s] = vPrime;
+    }
+    return delta;
+}
@@ -0,0 +1,185 @@
+#include "Checkpoint.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC 0x504b4354 // "TCKP"
+#define CHECKPOINT_VERSION 1
+
+namespace
+{
+template <typename T> void write(std::ofstream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> T read(std::ifstream& in)
+{
+    T value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
+} // namespace
+
+void Checkpoint::save(const std::string& path) const
+{
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out)
+        {
+            std::cerr << "ERROR (Checkpoint): cannot write " << tmp << std::endl;
+            exit(1);
+        }
+
+        write<uint32_t>(out, CHECKPOINT_MAGIC);
+        write<uint32_t>(out, CHECKPOINT_VERSION);
+        write<int32_t>(out, width);
+        write<int32_t>(out, height);
+        write<int32_t>(out, nbPieces);
+        write<int32_t>(out, iteration);
+        write<double>(out, delta);
+        write<uint64_t>(out, keys.size());
+
+        out.write(reinterpret_cast<const char*>(keys.data()),
+                  keys.size() * sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(values.data()),
+                  values.size() * sizeof(double));
+        // an action is its line, column and rotation, one byte each
+        for (const Action& a : actions)
+        {
+            write<int8_t>(out, a.getPosition().getX());
+            write<int8_t>(out, a.getPosition().getY());
+            write<int8_t>(out, a.getRotation());
+        }
+        out.close();
+        if (!out)
+        {
+            std::cerr << "ERROR (Checkpoint): failed writing " << tmp
+                      << std::endl;
+            exit(1);
+        }
+    }
+    // on disk before it replaces the previous snapshot, so that a crash
+    // leaves one of the two whole
+    int fd = open(tmp.c_str(), O_RDONLY);
+    if (fd < 0 || fsync(fd) != 0)
+    {
+        std::cerr << "ERROR (Checkpoint): cannot sync " << tmp << ": "
+                  << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+    close(fd);
+    if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "ERROR (Checkpoint): cannot rename " << tmp << " to "
+                  << path << ": " << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+}
+
+Checkpoint Checkpoint::load(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "ERROR (Checkpoint): cannot read " << path << std::endl;
+        exit(1);
+    }
+    if (read<uint32_t>(in) != CHECKPOINT_MAGIC ||
+        read<uint32_t>(in) != CHECKPOINT_VERSION)
+    {
+        std::cerr << "ERROR (Checkpoint): " << path
+                  << " is not a checkpoint of this version" << std::endl;
+        exit(1);
+    }
+
+    Checkpoint c;
+    c.width = read<int32_t>(in);
+    c.height = read<int32_t>(in);
+    c.nbPieces = read<int32_t>(in);
+    c.iteration = read<int32_t>(in);
+    c.delta = read<double>(in);
+    uint64_t n = read<uint64_t>(in);
+
+    // a key, a value and a 3-byte action per state, nothing after them
+    std::streampos data = in.tellg();
+    in.seekg(0, std::ios::end);
+    uint64_t bytes = in.tellg() - data;
+    in.seekg(data);
+    if (!in || bytes / (2 * sizeof(uint64_t) + 3) != n ||
+        bytes % (2 * sizeof(uint64_t) + 3) != 0)
+    {
+        std::cerr << "ERROR (Checkpoint): " << path
+                  << " is truncated or corrupt" << std::endl;
+        exit(1);
+    }
+
+    c.keys.resize(n);
+    c.values.resize(n);
+    in.read(reinterpret_cast<char*>(c.keys.data()), n * sizeof(uint64_t));
+    in.read(reinterpret_cast<char*>(c.values.data()), n * sizeof(double));
+    c.actions.reserve(n);
+    for (uint64_t i = 0; i < n; i++)
+    {
+        int x = read<int8_t>(in);
+        int y = read<int8_t>(in);
+        int rotation = read<int8_t>(in);
+        c.actions.emplace_back(Point(x, y), rotation);
+    }
+    if (!in)
+    {
+        std::cerr << "ERROR (Checkpoint): " << path << " is truncated"
+                  << std::endl;
+        exit(1);
+    }
+    return c;
+}
+
+CheckpointWriter::CheckpointWriter(std::string path)
+    : path_(std::move(path)), stopping_(false),
+      thread_(&CheckpointWriter::run, this)
+{
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void CheckpointWriter::submit(Checkpoint checkpoint)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = std::move(checkpoint);
+    }
+    wake_.notify_one();
+}
+
+void CheckpointWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        wake_.wait(lock, [this] { return pending_ || stopping_; });
+        if (!pending_)
+        {
+            return;
+        }
+        Checkpoint checkpoint = std::move(*pending_);
+        pending_.reset();
+
+        lock.unlock();
+        checkpoint.save(path_);
+        lock.lock();
+    }
+}
@@ -0,0 +1,190 @@
+#include "CompactPolicy.h"
+#include "CompiledPolicy.h"
+#include <cstring>
+
+namespace
+{
+// number of bytes that differ between two words
+int differingBytes(uint64_t a, uint64_t b)
+{
+    uint64_t x = a ^ b;
+    x |= x >> 4;
+    x |= x >> 2;
+    x |= x >> 1;
+    return __builtin_popcountll(x & 0x0101010101010101ULL);
+}
+
+int planesFor(int nbPieces)
+{
+    int planes = 1;
+    while ((1 << planes) < nbPieces)
+    {
+        planes++;
+    }
+    return planes;
+}
+
+void checkActionCount(const StateGraph& graph, int id)
+{
+    if (graph.actionEnd(id) - graph.actionBegin(id) > MAX_ACTION_INDEX + 1)
+    {
+        std::cerr << "ERROR (CompactPolicy): the state:\n"
+                  << graph.getState(id) << std::endl
+                  << "has more actions than a byte can index" << std::endl;
+        exit(1);
+    }
+}
+} // namespace
+
+CompactPolicy::CompactPolicy(const StateGraph& graph,
+                             const std::unordered_map<State, Action>& policy)
+    : indices_(graph.size(), NO_ACTION_INDEX)
+{
+    for (int s = 0; s < graph.size(); s++)
+    {
+        if (graph.actionBegin(s) == graph.actionEnd(s))
+        {
+            continue;
+        }
+        checkActionCount(graph, s);
+        auto it = policy.find(graph.getState(s));
+        if (it == policy.end())
+        {
+            continue;
+        }
+        for (int k = graph.actionBegin(s); k < graph.actionEnd(s); k++)
+        {
+            if (!(graph.getAction(k) != it->second))
+            {
+                indices_[s] = k - graph.actionBegin(s);
+                break;
+            }
+        }
+    }
+}
+
+CompactPolicy::CompactPolicy(const StateGraph& graph,
+                             const std::vector<int>& actionIds)
+    : indices_(graph.size(), NO_ACTION_INDEX)
+{
+    for (int s = 0; s < graph.size(); s++)
+    {
+        if (actionIds[s] >= 0)
+        {
+            checkActionCount(graph, s);
+            indices_[s] = actionIds[s] - graph.actionBegin(s);
+        }
+    }
+}
+
+int CompactPolicy::getActionId(const StateGraph& graph, int id) const
+{
+    if (indices_[id] == NO_ACTION_INDEX)
+    {
+        return -1;
+    }
+    return graph.actionBegin(id) + indices_[id];
+}
+
+std::unordered_map<State, Action>
+CompactPolicy::toActionMap(const StateGraph& graph) const
+{
+    std::unordered_map<State, Action> policy;
+    for (int s = 0; s < size(); s++)
+    {
+        int k = getActionId(graph, s);
+        if (k >= 0)
+        {
+            policy.emplace(graph.getState(s), graph.getAction(k));
+        }
+    }
+    return policy;
+}
+
+size_t CompactPolicy::diff(const CompactPolicy& other) const
+{
+    size_t n = std::min(indices_.size(), other.indices_.size());
+    size_t changed = std::max(indices_.size(), other.indices_.size()) - n;
+
+    // eight states per word compare
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t a, b;
+        std::memcpy(&a, &indices_[i], 8);
+        std::memcpy(&b, &other.indices_[i], 8);
+        changed += differingBytes(a, b);
+    }
+    for (; i < n; i++)
+    {
+        changed += indices_[i] != other.indices_[i];
+    }
+    return changed;
+}
+
+CompactAdversary::CompactAdversary(
+    const StateGraph& graph,
+    const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy)
+    : size_(graph.size()), present_((graph.size() + 63) / 64, 0),
+      planes_(planesFor(graph.getNbPieces()), present_)
+{
+    for (const auto& [state, tromino] : advPolicy)
+    {
+        int s = graph.find(state.key());
+        if (s < 0)
+        {
+            continue;
+        }
+        present_[s / 64] |= 1ULL << (s % 64);
+        for (size_t j = 0; j < planes_.size(); j++)
+        {
+            if ((tromino->getType() >> j) & 1)
+            {
+                planes_[j][s / 64] |= 1ULL << (s % 64);
+            }
+        }
+    }
+}
+
+int CompactAdversary::getPiece(int id) const
+{
+    if (!((present_[id / 64] >> (id % 64)) & 1))
+    {
+        return RANDOM_PIECE;
+    }
+    int piece = 0;
+    for (size_t j = 0; j < planes_.size(); j++)
+    {
+        piece |= ((planes_[j][id / 64] >> (id % 64)) & 1) << j;
+    }
+    return piece;
+}
+
+std::vector<int8_t> CompactAdversary::toPieces() const
+{
+    std::vector<int8_t> pieces(size_);
+    for (int s = 0; s < size_; s++)
+    {
+        pieces[s] = getPiece(s);
+    }
+    return pieces;
+}
+
+size_t CompactAdversary::diff(const CompactAdversary& other) const
+{
+    // the piece bits of a state without choice are all zero, so a state
+    // differs if any of its bits does
+    size_t changed = 0;
+    size_t words = std::min(present_.size(), other.present_.size());
+    size_t planes = std::min(planes_.size(), other.planes_.size());
+    for (size_t w = 0; w < words; w++)
+    {
+        uint64_t d = present_[w] ^ other.present_[w];
+        for (size_t j = 0; j < planes; j++)
+        {
+            d |= planes_[j][w] ^ other.planes_[j][w];
+        }
+        changed += __builtin_popcountll(d);
+    }
+    return changed + std::abs(size_ - other.size_);
+}
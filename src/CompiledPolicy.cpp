@@ -0,0 +1,421 @@
+#include "CompiledPolicy.h"
+#include "MDP.h"
+#include "Profiler.h"
+#include "Workers.h"
+#include <numeric>
+
+CompiledPolicy::CompiledPolicy(const StateGraph& graph,
+                               const State& s0,
+                               const std::unordered_map<State, Action>& policy)
+    : graph_(graph), nbPieces_(graph.getNbPieces()),
+      next_((size_t)graph.size() * nbPieces_, NO_ACTION),
+      score_(graph.size(), 0), start_(graph.find(s0.key()))
+{
+    for (int p = 0; p < nbPieces_; p++)
+    {
+        State root = s0.clone();
+        root.setNextTromino(Tromino(p));
+        roots_.push_back(graph.find(root.key()));
+    }
+
+    for (int s = 0; s < graph.size(); s++)
+    {
+        if (graph.actionBegin(s) == graph.actionEnd(s))
+        {
+            continue;
+        }
+
+        auto it = policy.find(graph.getState(s));
+        int chosen = -1;
+        if (it != policy.end())
+        {
+            for (int k = graph.actionBegin(s); k < graph.actionEnd(s); k++)
+            {
+                if (!(graph.getAction(k) != it->second))
+                {
+                    chosen = k;
+                    break;
+                }
+            }
+        }
+
+        for (int p = 0; p < nbPieces_; p++)
+        {
+            next_[(size_t)s * nbPieces_ + p] =
+                chosen < 0 ? MISSING_ACTION : graph.getTransition(chosen, p).next;
+        }
+        if (chosen >= 0)
+        {
+            score_[s] = graph.getTransition(chosen, 0).score;
+        }
+    }
+}
+
+std::vector<int8_t> CompiledPolicy::compileAdversary(
+    const StateGraph& graph,
+    const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy)
+{
+    std::vector<int8_t> pieces(graph.size(), RANDOM_PIECE);
+    for (const auto& [state, tromino] : advPolicy)
+    {
+        int s = graph.find(state.key());
+        if (s >= 0)
+        {
+            pieces[s] = tromino->getType();
+        }
+    }
+    return pieces;
+}
+
+int CompiledPolicy::play(const std::vector<int8_t>& adversary) const
+{
+    auto drawPiece = [&adversary](int s)
+    {
+        if (adversary[s] != RANDOM_PIECE)
+        {
+            return (int)adversary[s];
+        }
+        return PieceSet::get().draw();
+    };
+
+    int s = roots_[drawPiece(start_)];
+    int score = 0;
+
+    for (int nbAction = 0; nbAction < MAX_ACTION; nbAction++)
+    {
+        int first = next_[(size_t)s * nbPieces_];
+        if (first == NO_ACTION)
+        {
+            break;
+        }
+        checkAction(s);
+        score += score_[s];
+        s = next_[(size_t)s * nbPieces_ + drawPiece(s)];
+    }
+    return score;
+}
+
+CompiledPolicy::InducedChain
+CompiledPolicy::inducedChain(const std::vector<int8_t>& adversary) const
+{
+    // restrict the Markov chain induced by the policy and the adversary to
+    // the states it can reach from s0
+    InducedChain c;
+    std::vector<int32_t> local(score_.size(), -1);
+    std::vector<int32_t> chain;
+    std::vector<int32_t> stack;
+    for (int p = 0; p < nbPieces_; p++)
+    {
+        if (pieceProbability(adversary, start_, p) > 0.0)
+        {
+            stack.push_back(roots_[p]);
+        }
+    }
+    while (!stack.empty())
+    {
+        int s = stack.back();
+        stack.pop_back();
+        if (local[s] >= 0)
+        {
+            continue;
+        }
+        local[s] = chain.size();
+        chain.push_back(s);
+        if (next_[(size_t)s * nbPieces_] == NO_ACTION)
+        {
+            continue;
+        }
+        checkAction(s);
+        for (int p = 0; p < nbPieces_; p++)
+        {
+            if (pieceProbability(adversary, s, p) > 0.0)
+            {
+                stack.push_back(next_[(size_t)s * nbPieces_ + p]);
+            }
+        }
+    }
+
+    int n = chain.size();
+    c.succ.assign((size_t)n * nbPieces_, -1);
+    c.proba.assign((size_t)n * nbPieces_, 0.0);
+    c.reward.assign(n, 0.0);
+    for (int i = 0; i < n; i++)
+    {
+        int s = chain[i];
+        if (next_[(size_t)s * nbPieces_] == NO_ACTION)
+        {
+            continue;
+        }
+        c.reward[i] = score_[s];
+        for (int p = 0; p < nbPieces_; p++)
+        {
+            double prob = pieceProbability(adversary, s, p);
+            if (prob > 0.0)
+            {
+                c.succ[(size_t)i * nbPieces_ + p] =
+                    local[next_[(size_t)s * nbPieces_ + p]];
+                c.proba[(size_t)i * nbPieces_ + p] = prob;
+            }
+        }
+    }
+    for (int p = 0; p < nbPieces_; p++)
+    {
+        double prob = pieceProbability(adversary, start_, p);
+        if (prob > 0.0)
+        {
+            c.start.emplace_back(local[roots_[p]], prob);
+        }
+    }
+    return c;
+}
+
+double CompiledPolicy::expectedScore(const std::vector<int8_t>& adversary,
+                                     int horizon) const
+{
+    PROFILE_SCOPE(PROF_POLICY_EVAL);
+    InducedChain c = inducedChain(adversary);
+    int n = c.reward.size();
+    const std::vector<int32_t>& succ = c.succ;
+    const std::vector<double>& proba = c.proba;
+    const std::vector<double>& reward = c.reward;
+
+    // V_h(s) = expected score of the next h moves from s, two layers only;
+    // stops early once every game of the chain has ended
+    std::vector<double> V(n, 0.0);
+    std::vector<double> VNext(n, 0.0);
+    for (int h = 0; h < horizon; h++)
+    {
+        bool changed = false;
+        for (int i = 0; i < n; i++)
+        {
+            // game over states have no reward and no successor
+            double v = reward[i];
+            for (int p = 0; p < nbPieces_; p++)
+            {
+                int j = succ[(size_t)i * nbPieces_ + p];
+                if (j >= 0)
+                {
+                    v += proba[(size_t)i * nbPieces_ + p] * V[j];
+                }
+            }
+            changed = changed || v != V[i];
+            VNext[i] = v;
+        }
+        V.swap(VNext);
+        if (!changed)
+        {
+            break;
+        }
+    }
+
+    double expected = 0.0;
+    for (auto [i, prob] : c.start)
+    {
+        expected += prob * V[i];
+    }
+    return expected;
+}
+
+double CompiledPolicy::pieceProbability(const std::vector<int8_t>& adversary,
+                                        int id,
+                                        int piece) const
+{
+    if (adversary[id] != RANDOM_PIECE)
+    {
+        return adversary[id] == piece ? 1.0 : 0.0;
+    }
+    return PieceSet::get().getProbability(piece);
+}
+
+void CompiledPolicy::checkAction(int id) const
+{
+    if (next_[(size_t)id * nbPieces_] == MISSING_ACTION)
+    {
+        std::cerr << "ERROR the state:\n"
+                  << graph_.getState(id) << std::endl
+                  << "haven't any associated action in the provided policy"
+                  << std::endl;
+        exit(1);
+    }
+}
+
+GameDistribution CompiledPolicy::distribution(
+    const std::vector<int8_t>& adversary,
+    int horizon,
+    int nbThreads) const
+{
+    PROFILE_SCOPE(PROF_POLICY_EVAL);
+    InducedChain c = inducedChain(adversary);
+    int n = c.reward.size();
+
+    // predecessors of every chain state, so that each state gathers its
+    // probability and the states can be split between threads
+    std::vector<int32_t> predOffsets(n + 1, 0);
+    for (int32_t j : c.succ)
+    {
+        if (j >= 0)
+        {
+            predOffsets[j + 1]++;
+        }
+    }
+    std::partial_sum(predOffsets.begin(), predOffsets.end(),
+                     predOffsets.begin());
+    std::vector<int32_t> preds(predOffsets[n]);
+    std::vector<double> predProba(predOffsets[n]);
+    std::vector<int32_t> fill(predOffsets.begin(), predOffsets.end() - 1);
+    for (size_t t = 0; t < c.succ.size(); t++)
+    {
+        int32_t j = c.succ[t];
+        if (j >= 0)
+        {
+            preds[fill[j]] = t / nbPieces_;
+            predProba[fill[j]++] = c.proba[t];
+        }
+    }
+    int maxReward = 0;
+    std::vector<int32_t> gameOver;
+    for (int i = 0; i < n; i++)
+    {
+        maxReward = std::max(maxReward, (int)c.reward[i]);
+        if (std::all_of(&c.succ[(size_t)i * nbPieces_],
+                        &c.succ[(size_t)(i + 1) * nbPieces_],
+                        [](int32_t j) { return j < 0; }))
+        {
+            gameOver.push_back(i);
+        }
+    }
+
+    // P(state i, score lo + x) at mass[i * width + x]
+    int lo = 0;
+    int width = 1;
+    std::vector<double> mass(n, 0.0), nextMass;
+    for (auto [i, prob] : c.start)
+    {
+        mass[i] += prob;
+    }
+
+    GameDistribution d;
+    d.length.assign(horizon + 1, 0.0);
+    d.truncated = 0.0;
+    auto finish = [&](int i, int moves)
+    {
+        if ((int)d.score.size() < lo + width)
+        {
+            d.score.resize(lo + width, 0.0);
+        }
+        for (int x = 0; x < width; x++)
+        {
+            d.score[lo + x] += mass[(size_t)i * width + x];
+            d.length[moves] += mass[(size_t)i * width + x];
+        }
+    };
+
+    int nbWorkers = workersFor(n, std::max(1, nbThreads));
+    std::vector<std::vector<double>> columns(nbWorkers);
+    WorkerPool workers(nbWorkers);
+    for (int move = 0; move < horizon; move++)
+    {
+        // games over before this move stop here
+        for (int i : gameOver)
+        {
+            finish(i, move);
+        }
+
+        int nextWidth = width + maxReward;
+        nextMass.assign((size_t)n * nextWidth, 0.0);
+        workers.run(
+            [&](int w)
+            {
+                std::vector<double>& column = columns[w];
+                column.assign(nextWidth, 0.0);
+                int begin = (int64_t)n * w / nbWorkers;
+                int end = (int64_t)n * (w + 1) / nbWorkers;
+                for (int j = begin; j < end; j++)
+                {
+                    double* out = &nextMass[(size_t)j * nextWidth];
+                    for (int k = predOffsets[j]; k < predOffsets[j + 1]; k++)
+                    {
+                        int i = preds[k];
+                        double prob = predProba[k];
+                        const double* in = &mass[(size_t)i * width];
+                        double* shifted = out + (int)c.reward[i];
+                        for (int x = 0; x < width; x++)
+                        {
+                            shifted[x] += prob * in[x];
+                        }
+                    }
+                    for (int x = 0; x < nextWidth; x++)
+                    {
+                        column[x] += out[x];
+                    }
+                }
+            });
+
+        // drop the score columns that carry (almost) no probability
+        std::vector<double>& column = columns[0];
+        for (int w = 1; w < nbWorkers; w++)
+        {
+            for (int x = 0; x < nextWidth; x++)
+            {
+                column[x] += columns[w][x];
+            }
+        }
+        int first = 0, last = nextWidth - 1;
+        while (first < last && column[first] < DISTRIBUTION_CUTOFF)
+        {
+            d.truncated += column[first++];
+        }
+        while (last > first && column[last] < DISTRIBUTION_CUTOFF)
+        {
+            d.truncated += column[last--];
+        }
+
+        width = last - first + 1;
+        lo += first;
+        mass.resize((size_t)n * width);
+        for (int j = 0; j < n; j++)
+        {
+            std::copy_n(&nextMass[(size_t)j * nextWidth + first], width,
+                        &mass[(size_t)j * width]);
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        finish(i, horizon);
+    }
+    return d;
+}
+
+double GameDistribution::meanScore() const
+{
+    double mean = 0.0;
+    for (size_t x = 0; x < score.size(); x++)
+    {
+        mean += x * score[x];
+    }
+    return mean;
+}
+
+static int quantile(const std::vector<double>& distribution, double q)
+{
+    double cumulated = 0.0;
+    for (size_t x = 0; x < distribution.size(); x++)
+    {
+        cumulated += distribution[x];
+        if (cumulated >= q)
+        {
+            return x;
+        }
+    }
+    return distribution.size() - 1;
+}
+
+int GameDistribution::scoreQuantile(double q) const
+{
+    return quantile(score, q);
+}
+
+int GameDistribution::lengthQuantile(double q) const
+{
+    return quantile(length, q);
+}
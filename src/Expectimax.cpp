@@ -0,0 +1,171 @@
+#include "Expectimax.h"
+#include <float.h>
+
+// how many nodes are searched between two looks at the clock
+#define CLOCK_CHECK_PERIOD 16
+
+Expectimax::Expectimax(int maxDepth,
+                       double timeBudget,
+                       double lambda,
+                       LeafEvaluator evaluator)
+    : maxDepth_(maxDepth), timeBudget_(timeBudget), lambda_(lambda),
+      evaluator_(std::move(evaluator)), timedOut_(false), nodes_(0),
+      lastDepth_(0)
+{
+}
+
+Action Expectimax::chooseAction(const State& state)
+{
+    std::vector<Action> actions = state.getAvailableActions();
+    if (actions.empty())
+    {
+        return Action();
+    }
+
+    deadline_ = std::chrono::steady_clock::now() +
+                std::chrono::microseconds((long)(timeBudget_ * 1000));
+    timedOut_ = false;
+    nodes_ = 0;
+    if (table_.size() > TT_MAX_ENTRIES)
+    {
+        table_.clear();
+    }
+
+    const PieceSet& pieces = PieceSet::get();
+    Action best = actions[0];
+    lastDepth_ = 0;
+
+    // iterative deepening, a depth cut by the clock is thrown away
+    for (int depth = 1; depth <= maxDepth_; depth++)
+    {
+        Action bestAtDepth = actions[0];
+        double bestValue = -DBL_MAX;
+        for (const Action& a : actions)
+        {
+            // scopes nest with the recursion, a child rewinds to its parent
+            Arena::Scope scratch(Arena::local());
+            std::vector<State> placedStates = state.genAllStatesFromAction(a);
+            double q = 0.0;
+            for (size_t p = 0; p < placedStates.size(); p++)
+            {
+                State afterState = placedStates[p].completeLines();
+                q += pieces.getProbability(p) *
+                     (placedStates[p].evaluate() +
+                      lambda_ * search(afterState, depth - 1));
+            }
+            if (q > bestValue)
+            {
+                bestValue = q;
+                bestAtDepth = a;
+            }
+        }
+        if (timedOut_)
+        {
+            break;
+        }
+        best = bestAtDepth;
+        lastDepth_ = depth;
+    }
+    return best;
+}
+
+double Expectimax::search(const State& state, int depth)
+{
+    // game over is worth nothing at every depth, as in the solvers
+    std::vector<Action> actions = state.getAvailableActions();
+    if (actions.empty())
+    {
+        return 0.0;
+    }
+    if (depth == 0)
+    {
+        return evaluator_(state);
+    }
+
+    nodes_++;
+    if (timeBudget_ > 0 && nodes_ % CLOCK_CHECK_PERIOD == 0 &&
+        std::chrono::steady_clock::now() > deadline_)
+    {
+        timedOut_ = true;
+    }
+    if (timedOut_)
+    {
+        return 0.0;
+    }
+
+    std::vector<uint64_t> key = packBoard(state);
+    auto it = table_.find(key);
+    if (it != table_.end() && it->second.depth >= depth)
+    {
+        return it->second.value;
+    }
+
+    const PieceSet& pieces = PieceSet::get();
+    double value = -DBL_MAX;
+    for (const Action& a : actions)
+    {
+        Arena::Scope scratch(Arena::local());
+        std::vector<State> placedStates = state.genAllStatesFromAction(a);
+        double q = 0.0;
+        for (size_t p = 0; p < placedStates.size(); p++)
+        {
+            State afterState = placedStates[p].completeLines();
+            q += pieces.getProbability(p) *
+                 (placedStates[p].evaluate() +
+                  lambda_ * search(afterState, depth - 1));
+        }
+        value = std::max(value, q);
+    }
+
+    if (!timedOut_)
+    {
+        table_.insert_or_assign(std::move(key), Entry{depth, value});
+    }
+    return value;
+}
+
+std::vector<uint64_t> Expectimax::packBoard(const State& state)
+{
+    const Field& field = state.getField();
+    int cells = field.getWidth() * field.getHeight();
+
+    // board bits followed by the next piece
+    std::vector<uint64_t> key(cells / 64 + 2, 0);
+    for (int l = 0; l < field.getHeight(); l++)
+    {
+        int bit = l * field.getWidth();
+        key[bit / 64] |= field.getRow(l) << (bit % 64);
+        if (bit % 64 + field.getWidth() > 64)
+        {
+            key[bit / 64 + 1] |= field.getRow(l) >> (64 - bit % 64);
+        }
+    }
+    key.back() = state.getNextTromino().getType();
+    return key;
+}
+
+size_t Expectimax::BoardHash::operator()(const std::vector<uint64_t>& key) const
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (uint64_t word : key)
+    {
+        h ^= word;
+        h *= 0x100000001b3ULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+LeafEvaluator Expectimax::featureEvaluator(double height_weight,
+                                           double gap_reduction)
+{
+    return [=](const State& state)
+    {
+        const Field& field = state.getField();
+        // measured from one line above the top and from a board of holes,
+        // so that a living board is worth more than game over
+        return height_weight * (field.getHeight() + 1 - field.getMaxHeight()) +
+               gap_reduction *
+                   (field.getWidth() * field.getHeight() - state.gapCheck());
+    };
+}
@@ -1,4 +1,17 @@
 #include "Field.h"
+#include <algorithm>
+#include <iostream>
+
+Field::Field(int width, int height)
+    : width_(width), height_(height), rows_(height, 0, Arena::current())
+{
+    if (width_ <= 0 || width_ > MAX_FIELD_WIDTH)
+    {
+        std::cerr << "ERROR (Field): the width must be in [1, "
+                  << MAX_FIELD_WIDTH << "], got " << width_ << std::endl;
+        exit(1);
+    }
+}
 
 bool Field::isAvailable(int line, int column) const
 {
@@ -6,12 +19,12 @@ bool Field::isAvailable(int line, int column) const
         return false;
     if (column < 0 || column >= width_)
         return false;
-    return !grid_[line][column];
+    return !isFilled(line, column);
 }
 
 bool Field::isAvailable(const Tromino& t, int line, int column, int rotation) const
 {
-    std::vector<Offset> offsets = t.getOffsets(rotation);
+    const std::vector<Offset>& offsets = t.getOffsets(rotation);
     for (const Offset& off : offsets)
     {
         int l = line + off[0];
@@ -26,12 +39,12 @@ bool Field::addTromino(const Tromino& t, int line, int column, int rotation)
 {
     if (!isAvailable(t, line, column, rotation))
         return false;
-    std::vector<Offset> offsets = t.getOffsets(rotation);
+    const std::vector<Offset>& offsets = t.getOffsets(rotation);
     for (const Offset& off : offsets)
     {
         int l = line + off[0];
         int c = column + off[1];
-        grid_[l][c] = true;
+        rows_[l] |= 1ULL << c;
     }
     return true;
 }
@@ -43,19 +56,71 @@ std::vector<Point> Field::getEmptyPositions() const
     {
         for (int c = 0; c < width_; ++c)
         {
-            if (!grid_[l][c])
+            if (!isFilled(l, c))
                 positions.emplace_back(l, c);
         }
     }
     return positions;
 }
 
+int Field::getMaxHeight() const
+{
+    for (int l = 0; l < height_; ++l)
+    {
+        if (rows_[l])
+            return height_ - l;
+    }
+    return 0;
+}
+
+int Field::getColumnHeight(int column) const
+{
+    for (int l = 0; l < height_; ++l)
+    {
+        if (isFilled(l, column))
+            return height_ - l;
+    }
+    return 0;
+}
+
 Field Field::clone() const
 {
-    Field clone(grid_);
+    Field clone(width_, height_);
+    std::copy(rows_.begin(), rows_.end(), clone.rows_.begin());
     return clone;
 }
 
+int Field::nbFullLines() const
+{
+    uint64_t full = fullRow();
+    int count = 0;
+    for (int l = 0; l < height_; ++l)
+    {
+        count += rows_[l] == full;
+    }
+    return count;
+}
+
+int Field::clearLines()
+{
+    // Kept lines are copied down from the bottom, a full line is simply
+    // overwritten by the next kept one. Everything above the last kept
+    // line is emptied, its count is the number of lines cleared.
+    uint64_t full = fullRow();
+    int dst = height_ - 1;
+    for (int src = height_ - 1; src >= 0; --src)
+    {
+        uint64_t row = rows_[src];
+        rows_[dst] = row;
+        dst -= row != full;
+    }
+    for (int l = 0; l <= dst; ++l)
+    {
+        rows_[l] = 0;
+    }
+    return dst + 1;
+}
+
 std::ostream& operator<<(std::ostream& os, const Field& f)
 {
 
@@ -63,7 +128,7 @@ std::ostream& operator<<(std::ostream& os, const Field& f)
     {
         for (int c = 0; c < f.getWidth(); ++c)
         {
-            os << (f.getGrid()[l][c] ? '*' : '.');
+            os << (f.isFilled(l, c) ? '*' : '.');
         }
         os << '\n';
     }
@@ -3,12 +3,9 @@
 #include <algorithm>
 
 Game::Game(Field& field)
-    : state_(field, std::make_unique<IPiece>()), score_(0)
+    : state_(field, std::make_unique<Tromino>(PieceSet::get().draw())),
+      score_(0)
 {
-    if ((rand() / (double)RAND_MAX) < PROBA_I_PIECE)
-        state_ = State(field, std::make_unique<IPiece>());
-    else
-        state_ = State(field, std::make_unique<LPiece>());
 }
 
 void Game::playRandom()
@@ -0,0 +1,173 @@
+#include "GraphExport.h"
+#include <filesystem>
+#include <iostream>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "the .npy files are written in host byte order");
+
+NpyWriter::NpyWriter(const std::string& path,
+                     const std::string& descr,
+                     const std::vector<size_t>& shape)
+    : path_(path), out_(path, std::ios::binary), expected_(1), written_(0),
+      closed_(false)
+{
+    if (!out_)
+    {
+        std::cerr << "ERROR (NpyWriter): cannot write " << path << std::endl;
+        exit(1);
+    }
+
+    std::string dims;
+    for (size_t d : shape)
+    {
+        expected_ *= d;
+        dims += (dims.empty() ? "" : ", ") + std::to_string(d);
+    }
+    if (shape.size() == 1)
+    {
+        dims += ",";
+    }
+    std::string header = "{'descr': '" + descr +
+                         "', 'fortran_order': False, 'shape': (" + dims +
+                         "), }";
+    // magic, version and length take 10 bytes, the data starts 64-aligned
+    size_t total = 10 + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' ');
+    header += '\n';
+
+    uint16_t length = header.size();
+    out_.write("\x93NUMPY\x01\x00", 8);
+    out_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out_.write(header.data(), header.size());
+}
+
+void NpyWriter::close()
+{
+    closed_ = true;
+    out_.close();
+    if (written_ != expected_ || !out_)
+    {
+        std::cerr << "ERROR (NpyWriter): " << path_ << " got " << written_
+                  << " of " << expected_ << " elements" << std::endl;
+        exit(1);
+    }
+}
+
+NpyWriter::~NpyWriter()
+{
+    if (closed_)
+    {
+        return;
+    }
+    out_.close();
+    if (written_ != expected_ || !out_)
+    {
+        std::cerr << "WARNING (NpyWriter): " << path_ << " closed with "
+                  << written_ << " of " << expected_ << " elements"
+                  << std::endl;
+    }
+}
+
+void NpyWriter::writeBytes(const void* data, size_t count, size_t size)
+{
+    out_.write(static_cast<const char*>(data), count * size);
+    written_ += count;
+}
+
+namespace
+{
+// field(i) for i in [0, count), through a bounded buffer
+template <typename T, typename Field>
+void writeGathered(NpyWriter& writer, size_t count, Field field)
+{
+    std::vector<T> buffer;
+    buffer.reserve(std::min<size_t>(count, NPY_CHUNK));
+    for (size_t begin = 0; begin < count; begin += NPY_CHUNK)
+    {
+        size_t end = std::min<size_t>(count, begin + NPY_CHUNK);
+        buffer.clear();
+        for (size_t i = begin; i < end; i++)
+        {
+            buffer.push_back(field(i));
+        }
+        writer.write(buffer.data(), buffer.size());
+    }
+}
+} // namespace
+
+void exportGraph(const StateGraph& graph, const std::string& directory)
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        std::cerr << "ERROR (exportGraph): cannot create " << directory << ": "
+                  << error.message() << std::endl;
+        exit(1);
+    }
+    std::string dir = directory + "/";
+    size_t nbStates = graph.size();
+    size_t nbActions = graph.nbActions();
+    size_t nbPieces = graph.getNbPieces();
+    const std::vector<Transition>& transitions = graph.getTransitions();
+    const std::vector<Action>& actions = graph.getActions();
+
+    {
+        int32_t meta[] = {graph.getWidth(), graph.getHeight(),
+                          graph.getNbPieces()};
+        NpyWriter writer(dir + "meta.npy", "<i4", {3});
+        writer.write(meta, 3);
+        writer.close();
+    }
+    {
+        NpyWriter writer(dir + "keys.npy", "<u8", {nbStates});
+        writer.write(graph.getKeys().data(), nbStates);
+        writer.close();
+    }
+    {
+        NpyWriter writer(dir + "action_offsets.npy", "<i4", {nbStates + 1});
+        writer.write(graph.getActionOffsets().data(), nbStates + 1);
+        writer.close();
+    }
+    {
+        NpyWriter writer(dir + "actions.npy", "|i1", {nbActions, 3});
+        writeGathered<int8_t>(writer, nbActions * 3,
+                              [&](size_t i)
+                              {
+                                  const Action& a = actions[i / 3];
+                                  int fields[] = {a.getPosition().getX(),
+                                                  a.getPosition().getY(),
+                                                  a.getRotation()};
+                                  return (int8_t)fields[i % 3];
+                              });
+        writer.close();
+    }
+    {
+        NpyWriter writer(dir + "next.npy", "<i4", {nbActions, nbPieces});
+        writeGathered<int32_t>(writer, transitions.size(),
+                               [&](size_t t) { return transitions[t].next; });
+        writer.close();
+    }
+    {
+        const PieceSet& pieces = PieceSet::get();
+        NpyWriter writer(dir + "probabilities.npy", "<f8",
+                         {nbActions, nbPieces});
+        writeGathered<double>(writer, transitions.size(),
+                              [&](size_t t)
+                              { return pieces.getProbability(t % nbPieces); });
+        writer.close();
+    }
+
+    std::pair<const char*, uint8_t Transition::*> features[] = {
+        {"lines", &Transition::lines},
+        {"height", &Transition::height},
+        {"score", &Transition::score},
+        {"gaps", &Transition::gaps}};
+    for (auto [name, member] : features)
+    {
+        NpyWriter writer(dir + name + ".npy", "|u1", {nbActions, nbPieces});
+        writeGathered<uint8_t>(writer, transitions.size(),
+                               [&](size_t t) { return transitions[t].*member; });
+        writer.close();
+    }
+}
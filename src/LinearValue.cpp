@@ -0,0 +1,75 @@
+#include "LinearValue.h"
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+
+std::vector<double> LinearValue::features(const State& state)
+{
+    const Field& field = state.getField();
+    int width = field.getWidth();
+    std::vector<double> phi(nbFeatures(width));
+
+    phi[0] = 1.0;
+    double bumpiness = 0.0;
+    for (int c = 0; c < width; c++)
+    {
+        phi[1 + c] = field.getColumnHeight(c);
+        if (c > 0)
+        {
+            bumpiness += std::abs(phi[1 + c] - phi[c]);
+        }
+    }
+    phi[width + 1] = bumpiness;
+    phi[width + 2] = state.gapCheck();
+    phi[width + 3] = field.getMaxHeight();
+    return phi;
+}
+
+double LinearValue::value(const State& state) const
+{
+    std::vector<double> phi = features(state);
+    double v = 0.0;
+    for (size_t i = 0; i < phi.size() && i < weights_.size(); i++)
+    {
+        v += weights_[i] * phi[i];
+    }
+    return v;
+}
+
+LeafEvaluator LinearValue::evaluator() const
+{
+    LinearValue copy(weights_);
+    return [copy](const State& state) { return copy.value(state); };
+}
+
+void LinearValue::save(const std::string& path) const
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cerr << "ERROR (LinearValue): cannot write " << path << std::endl;
+        exit(1);
+    }
+    out << std::setprecision(17);
+    for (double w : weights_)
+    {
+        out << w << "\n";
+    }
+}
+
+LinearValue LinearValue::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "ERROR (LinearValue): cannot read " << path << std::endl;
+        exit(1);
+    }
+    std::vector<double> weights;
+    double w;
+    while (in >> w)
+    {
+        weights.push_back(w);
+    }
+    return LinearValue(std::move(weights));
+}
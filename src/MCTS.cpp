@@ -0,0 +1,207 @@
+#include "MCTS.h"
+#include <chrono>
+#include <cmath>
+#include <float.h>
+#include <thread>
+
+MCTS::Node::Node(State s) : state(std::move(s)), totalVisits(0)
+{
+    actions = state.getAvailableActions();
+    size_t nbActions = actions.size();
+    values.assign(nbActions, 0.0);
+    visits.assign(nbActions, 0);
+    children.assign(nbActions * PieceSet::get().size(), -1);
+
+    // the score of a placement does not depend on the piece drawn after it
+    Tromino anyPiece(0);
+    for (const Action& a : actions)
+    {
+        rewards.push_back(state.applyActionTromino(a, anyPiece).evaluate());
+    }
+}
+
+MCTS::MCTS(int nbThreads,
+           int iterations,
+           double timeBudget,
+           double exploration,
+           double lambda,
+           int playoutDepth,
+           LeafEvaluator heuristic)
+    : nbThreads_(std::max(1, nbThreads)), iterations_(iterations),
+      timeBudget_(timeBudget), exploration_(exploration), lambda_(lambda),
+      playoutDepth_(playoutDepth), heuristic_(std::move(heuristic)),
+      lastIterations_(0)
+{
+}
+
+Action MCTS::chooseAction(const State& state)
+{
+    std::vector<Action> actions = state.getAvailableActions();
+    lastIterations_ = 0;
+    if (actions.empty())
+    {
+        return Action();
+    }
+
+    std::vector<std::vector<int>> rootVisits(nbThreads_);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < nbThreads_; w++)
+    {
+        uint32_t seed = rand();
+        workers.emplace_back([this, &state, &rootVisits, w, seed]()
+                             { rootVisits[w] = searchTree(state, seed); });
+    }
+    for (std::thread& t : workers)
+    {
+        t.join();
+    }
+
+    // the most visited action over all the trees
+    std::vector<long> visits(actions.size(), 0);
+    for (const std::vector<int>& v : rootVisits)
+    {
+        for (size_t k = 0; k < v.size(); k++)
+        {
+            visits[k] += v[k];
+            lastIterations_ += v[k];
+        }
+    }
+    return actions[std::max_element(visits.begin(), visits.end()) -
+                   visits.begin()];
+}
+
+std::vector<int> MCTS::searchTree(const State& root, uint32_t seed) const
+{
+    std::mt19937 rng(seed);
+    int nbPieces = PieceSet::get().size();
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds((long)(timeBudget_ * 1000));
+
+    std::vector<Node> tree;
+    tree.emplace_back(root.clone());
+    std::vector<std::pair<int, int>> path; // (node, action) from the root
+
+    for (int it = 0; it < iterations_; it++)
+    {
+        if (timeBudget_ > 0 && it % 16 == 0 &&
+            std::chrono::steady_clock::now() > deadline)
+        {
+            break;
+        }
+
+        // selection down to an unseen (action, piece) outcome, expanded
+        // into a new leaf valued by a playout
+        path.clear();
+        double G = 0.0;
+        int n = 0;
+        while (!tree[n].actions.empty())
+        {
+            int a = selectAction(tree[n]);
+            int p = drawPiece(rng);
+            path.emplace_back(n, a);
+
+            int32_t child = tree[n].children[a * nbPieces + p];
+            if (child < 0)
+            {
+                State afterState =
+                    tree[n]
+                        .state.applyActionTromino(tree[n].actions[a], Tromino(p))
+                        .completeLines();
+                G = playout(afterState.clone(), rng);
+                tree[n].children[a * nbPieces + p] = tree.size();
+                tree.emplace_back(std::move(afterState));
+                break;
+            }
+            n = child;
+        }
+
+        for (auto step = path.rbegin(); step != path.rend(); ++step)
+        {
+            Node& node = tree[step->first];
+            int a = step->second;
+            G = node.rewards[a] + lambda_ * G;
+            node.values[a] += G;
+            node.visits[a]++;
+            node.totalVisits++;
+        }
+    }
+    return tree[0].visits;
+}
+
+int MCTS::selectAction(const Node& node) const
+{
+    int best = 0;
+    double bestScore = -DBL_MAX;
+    double logTotal = std::log((double)node.totalVisits);
+    for (size_t k = 0; k < node.actions.size(); k++)
+    {
+        if (node.visits[k] == 0)
+        {
+            return k;
+        }
+        double score = node.values[k] / node.visits[k] +
+                       exploration_ * std::sqrt(logTotal / node.visits[k]);
+        if (score > bestScore)
+        {
+            bestScore = score;
+            best = k;
+        }
+    }
+    return best;
+}
+
+double MCTS::playout(State state, std::mt19937& rng) const
+{
+    double ret = 0.0, discount = 1.0;
+    for (int d = 0; d < playoutDepth_; d++)
+    {
+        std::vector<Action> actions = state.getAvailableActions();
+        if (actions.empty())
+        {
+            return ret;
+        }
+        Tromino next(drawPiece(rng));
+
+        size_t chosen = rng() % actions.size();
+        if (heuristic_)
+        {
+            double best = -DBL_MAX;
+            for (size_t k = 0; k < actions.size(); k++)
+            {
+                State placedState = state.applyActionTromino(actions[k], next);
+                double v = placedState.evaluate() +
+                           heuristic_(placedState.completeLines());
+                if (v > best)
+                {
+                    best = v;
+                    chosen = k;
+                }
+            }
+        }
+
+        State placedState = state.applyActionTromino(actions[chosen], next);
+        ret += discount * placedState.evaluate();
+        discount *= lambda_;
+        state = placedState.completeLines();
+    }
+    if (heuristic_)
+    {
+        ret += discount * heuristic_(state);
+    }
+    return ret;
+}
+
+int MCTS::drawPiece(std::mt19937& rng) const
+{
+    const PieceSet& pieces = PieceSet::get();
+    double r = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    for (int p = 0; p < pieces.size() - 1; p++)
+    {
+        if (r < pieces.getProbability(p))
+        {
+            return p;
+        }
+        r -= pieces.getProbability(p);
+    }
+    return pieces.size() - 1;
+}
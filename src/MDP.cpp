@@ -1,4 +1,68 @@
 #include "MDP.h"
+#include "Profiler.h"
+#include "Trace.h"
+#include "Workers.h"
+
+// overwrite the value of a state, its key is only cloned on first insertion
+template <typename Map, typename Value>
+static void assign(Map& map, const State& state, Value&& value)
+{
+    auto it = map.find(state);
+    if (it == map.end())
+    {
+        map.emplace(state.clone(), std::forward<Value>(value));
+    }
+    else
+    {
+        it->second = std::forward<Value>(value);
+    }
+}
+
+template <typename Map>
+static typename Map::iterator lookup(Map& map, const State& state)
+{
+    PROFILE_SCOPE(PROF_MAP_LOOKUP);
+    return map.find(state);
+}
+
+// Gaussian elimination with partial pivoting on the augmented n x (n + 1)
+// matrix A, for the small dense systems of the solvers
+static std::vector<double> solveLinearSystem(std::vector<std::vector<double>> A)
+{
+    int n = A.size();
+    for (int c = 0; c < n; c++)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < n; r++)
+        {
+            if (std::abs(A[r][c]) > std::abs(A[pivot][c]))
+            {
+                pivot = r;
+            }
+        }
+        std::swap(A[c], A[pivot]);
+        for (int r = c + 1; r < n; r++)
+        {
+            double factor = A[r][c] / A[c][c];
+            for (int k = c; k <= n; k++)
+            {
+                A[r][k] -= factor * A[c][k];
+            }
+        }
+    }
+
+    std::vector<double> x(n);
+    for (int c = n - 1; c >= 0; c--)
+    {
+        double sum = A[c][n];
+        for (int k = c + 1; k < n; k++)
+        {
+            sum -= A[c][k] * x[k];
+        }
+        x[c] = sum / A[c][c];
+    }
+    return x;
+}
 
 std::unordered_map<State, Action>
 MDP::actionValueIteration(double lambda,
@@ -15,12 +79,91 @@ MDP::actionValueIteration(double lambda,
     }
     std::unordered_map<State, double> V = generateReachableStates(s0_.clone());
     std::unordered_map<State, Action> A;
+    return runActionValueIteration(V, A, 0, lambda, line_weight, height_weight,
+                                   score_weight, gap_reduction, epsilon,
+                                   maxIteration);
+}
+
+std::unordered_map<State, Action>
+MDP::resumeActionValueIteration(const std::string& path,
+                                double lambda,
+                                double line_weight,
+                                double height_weight,
+                                double score_weight,
+                                double gap_reduction,
+                                double epsilon,
+                                int maxIteration)
+{
+    Checkpoint checkpoint = Checkpoint::load(path);
+    if (checkpoint.width != width_ || checkpoint.height != height_ ||
+        checkpoint.nbPieces != PieceSet::get().size())
+    {
+        std::cerr << "ERROR (resumeActionValueIteration): " << path
+                  << " was saved for another board or piece set" << std::endl;
+        exit(1);
+    }
+    if (DEBUG)
+    {
+        std::cout << "Resuming Full Feature Policy Value Iteration after i = "
+                  << checkpoint.iteration << " and delta = " << checkpoint.delta
+                  << std::endl;
+    }
+
+    std::unordered_map<State, double> V = generateReachableStates(s0_.clone());
+    std::unordered_map<State, Action> A;
+    for (size_t i = 0; i < checkpoint.keys.size(); i++)
+    {
+        State state = State::fromKey(checkpoint.keys[i], width_, height_);
+        auto it = V.find(state);
+        if (it == V.end())
+        {
+            std::cerr << "ERROR (resumeActionValueIteration): " << path
+                      << " holds a non-reachable state" << std::endl;
+            exit(1);
+        }
+        it->second = checkpoint.values[i];
+        if (checkpoint.actions[i].getRotation() != NO_CHECKPOINT_ACTION)
+        {
+            A.emplace(std::move(state), checkpoint.actions[i]);
+        }
+    }
+
+    if (checkpoint.delta <= epsilon)
+    {
+        return A;
+    }
+    return runActionValueIteration(V, A, checkpoint.iteration + 1, lambda,
+                                   line_weight, height_weight, score_weight,
+                                   gap_reduction, epsilon, maxIteration);
+}
+
+std::unordered_map<State, Action>
+MDP::runActionValueIteration(std::unordered_map<State, double>& V,
+                             std::unordered_map<State, Action>& A,
+                             int firstIteration,
+                             double lambda,
+                             double line_weight,
+                             double height_weight,
+                             double score_weight,
+                             double gap_reduction,
+                             double epsilon,
+                             int maxIteration)
+{
+    const PieceSet& pieces = PieceSet::get();
 
     double vAfter, vPrime, delta;
     delta = DBL_MAX;
 
-    for (int i = 0; i < maxIteration && delta > epsilon; i++)
+    // the writer flushes the last snapshot when the solve returns
+    std::unique_ptr<CheckpointWriter> writer;
+    if (checkpointPeriod_ > 0)
     {
+        writer = std::make_unique<CheckpointWriter>(checkpointPath_);
+    }
+
+    for (int i = firstIteration; i < maxIteration && delta > epsilon; i++)
+    {
+        PROFILE_SCOPE(PROF_SWEEP);
         delta = 0.0;
         for (auto& [currState, currValue] : V)
         {
@@ -32,33 +175,40 @@ MDP::actionValueIteration(double lambda,
 
             std::vector<double> rewards(actions.size());
 
-            for (size_t k = 0; k < actions.size(); k++)
             {
-                rewards[k] = 0.0;
-                for (State& placedState :
-                     currState.genAllStatesFromAction(actions[k]))
+                // the boards built here die with the sweep step, the arena
+                // saves their allocations
+                Arena::Scope scratch(Arena::local());
+                for (size_t k = 0; k < actions.size(); k++)
                 {
-                    State afterState = placedState.completeLines();
-
-                    auto it = V.find(afterState);
-                    if (it == V.end())
+                    rewards[k] = 0.0;
+                    std::vector<State> placedStates =
+                        currState.genAllStatesFromAction(actions[k]);
+                    for (size_t p = 0; p < placedStates.size(); p++)
                     {
-                        std::cerr << "ERROR (fullFeaturePolicy): the "
-                                     "state cannot be derived into "
-                                     "a non-reachable state"
-                                  << std::endl;
-                        exit(1);
+                        State& placedState = placedStates[p];
+                        State afterState = placedState.completeLines();
+
+                        auto it = lookup(V, afterState);
+                        if (it == V.end())
+                        {
+                            std::cerr << "ERROR (fullFeaturePolicy): the "
+                                         "state cannot be derived into "
+                                         "a non-reachable state"
+                                      << std::endl;
+                            exit(1);
+                        }
+                        vAfter = it->second;
+
+                        double immediate_reward =
+                            (line_weight * placedState.nbCompleteLines()) -
+                            (height_weight * getMaxHeight(placedState.getField())) +
+                            (score_weight * placedState.evaluate()) -
+                            (gap_reduction * placedState.gapCheck());
+
+                        rewards[k] += pieces.getProbability(p) *
+                                      (immediate_reward + lambda * vAfter);
                     }
-                    vAfter = it->second;
-
-                    double immediate_reward =
-                        (line_weight * placedState.nbCompleteLines()) -
-                        (height_weight * getMaxHeight(placedState.getField())) +
-                        (score_weight * placedState.evaluate()) -
-                        (gap_reduction * placedState.gapCheck());
-
-                    rewards[k] +=
-                        PROBA_I_PIECE * (immediate_reward + lambda * vAfter);
                 }
             }
             vPrime = *std::max_element(rewards.begin(), rewards.end());
@@ -67,19 +217,25 @@ MDP::actionValueIteration(double lambda,
             {
                 if (vPrime == rewards[k])
                 {
-                    A.insert_or_assign(currState.clone(), actions[k]);
+                    assign(A, currState, actions[k]);
                     break;
                 }
             }
 
             delta = std::max(delta, std::abs(vPrime - currValue));
-            V.insert_or_assign(currState.clone(), vPrime);
+            currValue = vPrime;
         }
 
         if (DEBUG)
         {
             std::cout << "i = " << i << " and delta = " << delta << std::endl;
         }
+
+        bool last = i + 1 == maxIteration || delta <= epsilon;
+        if (writer && ((i + 1) % checkpointPeriod_ == 0 || last))
+        {
+            writer->submit(snapshot(V, A, i, delta));
+        }
     }
 
     if (DEBUG)
@@ -92,7 +248,654 @@ MDP::actionValueIteration(double lambda,
         std::cout << "\naverage over final V " << sum / V.size() << std::endl;
     }
 
-    return A;
+    return std::move(A);
+}
+
+std::unordered_map<State, Action>
+MDP::acceleratedActionValueIteration(double lambda,
+                                     double line_weight,
+                                     double height_weight,
+                                     double score_weight,
+                                     double gap_reduction,
+                                     double epsilon,
+                                     int maxIteration,
+                                     int memory)
+{
+    if (DEBUG)
+    {
+        std::cout << "Accelerated Full Feature Policy Value Iteration"
+                  << std::endl;
+    }
+    const StateGraph& graph = getGraph();
+    BellmanBackup backup(graph,
+                         transitionRewards(graph, line_weight, height_weight,
+                                           score_weight, gap_reduction),
+                         transitionCoefficients(graph, lambda));
+    size_t n = graph.size();
+
+    // x is the current iterate and tx = T(x), the residual is tx - x
+    std::vector<double> x(n, 0.0), tx(n), candidate(n), tCandidate(n);
+    double residual = backup.expectationMax(x, tx, nullptr);
+
+    // differences between consecutive residuals (dF) and images (dT)
+    std::vector<std::vector<double>> dF, dT;
+    std::vector<double> prevF, prevTx;
+    int sweeps = 1, rejected = 0;
+
+    for (int i = 0; i < maxIteration && residual > epsilon; i++)
+    {
+        std::vector<double> f(n);
+        for (size_t s = 0; s < n; s++)
+        {
+            f[s] = tx[s] - x[s];
+        }
+        if (memory > 0 && !prevF.empty())
+        {
+            dF.emplace_back(n);
+            dT.emplace_back(n);
+            for (size_t s = 0; s < n; s++)
+            {
+                dF.back()[s] = f[s] - prevF[s];
+                dT.back()[s] = tx[s] - prevTx[s];
+            }
+            if ((int)dF.size() > memory)
+            {
+                dF.erase(dF.begin());
+                dT.erase(dT.begin());
+            }
+        }
+        prevF = f;
+        prevTx = tx;
+
+        // gamma = argmin |f - dF gamma|, through the (regularised) normal
+        // equations since the history is tiny
+        int m = dF.size();
+        std::vector<double> gamma(m, 0.0);
+        if (m > 0)
+        {
+            std::vector<std::vector<double>> A(m, std::vector<double>(m + 1));
+            double trace = 0.0;
+            for (int a = 0; a < m; a++)
+            {
+                for (int b = a; b < m; b++)
+                {
+                    A[a][b] = std::inner_product(dF[a].begin(), dF[a].end(),
+                                                 dF[b].begin(), 0.0);
+                    A[b][a] = A[a][b];
+                }
+                A[a][m] =
+                    std::inner_product(dF[a].begin(), dF[a].end(), f.begin(), 0.0);
+                trace += A[a][a];
+            }
+            for (int a = 0; a < m; a++)
+            {
+                A[a][a] += 1e-10 * trace + DBL_MIN;
+            }
+            gamma = solveLinearSystem(std::move(A));
+        }
+
+        for (size_t s = 0; s < n; s++)
+        {
+            candidate[s] = tx[s];
+            for (int a = 0; a < m; a++)
+            {
+                candidate[s] -= gamma[a] * dT[a][s];
+            }
+        }
+
+        double candidateResidual =
+            backup.expectationMax(candidate, tCandidate, nullptr);
+        sweeps++;
+
+        if (m == 0 || candidateResidual < residual)
+        {
+            x.swap(candidate);
+            tx.swap(tCandidate);
+            residual = candidateResidual;
+        }
+        else
+        {
+            // the extrapolation did not help: plain step and fresh history
+            x.swap(tx);
+            residual = backup.expectationMax(x, tx, nullptr);
+            sweeps++;
+            rejected++;
+            dF.clear();
+            dT.clear();
+            prevF.clear();
+        }
+
+        if (DEBUG)
+        {
+            std::cout << "i = " << i << " and residual = " << residual
+                      << std::endl;
+        }
+    }
+
+    if (DEBUG)
+    {
+        std::cout << sweeps << " sweeps, " << rejected
+                  << " rejected extrapolations" << std::endl;
+    }
+
+    std::vector<int> policy(n, -1);
+    backup.expectationMax(x, tx, &policy);
+    return toActionMap(graph, policy);
+}
+
+FiniteHorizonSolution MDP::finiteHorizonIteration(double line_weight,
+                                                  double height_weight,
+                                                  double score_weight,
+                                                  double gap_reduction,
+                                                  int horizon,
+                                                  double epsilon,
+                                                  int tailLength)
+{
+    if (DEBUG)
+    {
+        std::cout << "Finite Horizon Backward Induction" << std::endl;
+    }
+    const StateGraph& graph = getGraph();
+    BellmanBackup backup(graph,
+                         transitionRewards(graph, line_weight, height_weight,
+                                           score_weight, gap_reduction),
+                         transitionCoefficients(graph, 1.0));
+    size_t n = graph.size();
+
+    // V holds the best total reward of the last k moves and VNext the one
+    // of k + 1 moves; increments[k % ring] keeps V_k - V_(k-1) for the
+    // last 2 * FINITE_HORIZON_MAX_PERIOD steps
+    int ring = 2 * FINITE_HORIZON_MAX_PERIOD;
+    std::vector<double> V(n, 0.0), VNext(n);
+    std::vector<std::vector<double>> increments(ring, std::vector<double>(n));
+    std::vector<int> policy(n, -1);
+    FiniteHorizonSolution solution;
+    int period = 0;
+    int k = 0;
+
+    while (k < horizon && period == 0)
+    {
+        PROFILE_SCOPE(PROF_SWEEP);
+        backup.expectationMax(V, VNext, &policy);
+        if (k < tailLength)
+        {
+            // tail[k] is played with k + 1 moves left
+            solution.tail.emplace_back(graph, policy);
+        }
+        k++;
+        std::vector<double>& increment = increments[k % ring];
+        for (size_t s = 0; s < n; s++)
+        {
+            increment[s] = VNext[s] - V[s];
+        }
+        V.swap(VNext);
+
+        // once the increments repeat with some period d, the greedy
+        // policies do too and the remaining steps only add the same cycle
+        // of increments
+        for (int d = 1; d <= FINITE_HORIZON_MAX_PERIOD && k >= tailLength &&
+                        k > 2 * d;
+             d++)
+        {
+            double change = 0.0;
+            for (int j = 0; j < d; j++)
+            {
+                const std::vector<double>& a = increments[(k - j) % ring];
+                const std::vector<double>& b = increments[(k - j - d) % ring];
+                for (size_t s = 0; s < n; s++)
+                {
+                    change = std::max(change, std::abs(a[s] - b[s]));
+                }
+            }
+            if (change <= epsilon)
+            {
+                period = d;
+                break;
+            }
+        }
+        if (DEBUG && period > 0)
+        {
+            std::cout << "k = " << k << ", increments repeat every " << period
+                      << " steps" << std::endl;
+        }
+    }
+    solution.steps = k;
+    solution.error = period > 0 ? (horizon - k) * std::max(epsilon, 0.0) : 0.0;
+
+    // value of the full horizon from s0, the first piece drawn at random;
+    // step k + j adds the increment of step k + j - period * ceil(j / period)
+    const PieceSet& pieces = PieceSet::get();
+    int remaining = horizon - k;
+    solution.value = 0.0;
+    for (int p = 0; p < pieces.size(); p++)
+    {
+        State root = s0_.clone();
+        root.setNextTromino(Tromino(p));
+        int id = graph.find(root.key());
+        double value = V[id];
+        for (int j = 0; period > 0 && j < period; j++)
+        {
+            int cycles = remaining / period + (j < remaining % period);
+            value += cycles * increments[(k - period + 1 + j) % ring][id];
+        }
+        solution.value += pieces.getProbability(p) * value;
+    }
+    solution.policy = toActionMap(graph, policy);
+    return solution;
+}
+
+LinearValue MDP::fittedValueIteration(double lambda,
+                                      double line_weight,
+                                      double height_weight,
+                                      double score_weight,
+                                      double gap_reduction,
+                                      int nbIterations,
+                                      int batchSize,
+                                      double exploration)
+{
+    if (DEBUG)
+    {
+        std::cout << "Fitted Linear Value Iteration" << std::endl;
+    }
+    const PieceSet& pieces = PieceSet::get();
+    LinearValue V(width_);
+    int d = LinearValue::nbFeatures(width_);
+
+    auto immediateReward = [&](const State& placedState)
+    {
+        return (line_weight * placedState.nbCompleteLines()) -
+               (height_weight * getMaxHeight(placedState.getField())) +
+               (score_weight * placedState.evaluate()) -
+               (gap_reduction * placedState.gapCheck());
+    };
+
+    // approximate value iteration may oscillate, so the weights whose
+    // batch collected the most reward per move are the ones returned
+    LinearValue best = V;
+    double bestReward = -DBL_MAX;
+
+    for (int i = 0; i < nbIterations; i++)
+    {
+        // normal equations of the batch, accumulated on the fly so memory
+        // does not depend on the batch size
+        std::vector<std::vector<double>> A(d, std::vector<double>(d + 1, 0.0));
+        double collected = 0.0;
+
+        State curr = s0_.clone();
+        curr.setNextTromino(Tromino(pieces.draw()));
+        int length = 0;
+
+        for (int sample = 0; sample < batchSize; sample++)
+        {
+            std::vector<Action> actions = curr.getAvailableActions();
+            double target = 0.0;
+            std::vector<State> chosen;
+
+            if (!actions.empty())
+            {
+                target = -DBL_MAX;
+                size_t greedy = 0;
+                std::vector<std::vector<State>> outcomes(actions.size());
+                for (size_t k = 0; k < actions.size(); k++)
+                {
+                    outcomes[k] = curr.genAllStatesFromAction(actions[k]);
+                    double q = 0.0;
+                    for (size_t p = 0; p < outcomes[k].size(); p++)
+                    {
+                        // game over is worth exactly nothing, which the
+                        // features alone cannot tell
+                        State afterState = outcomes[k][p].completeLines();
+                        double vAfter = afterState.getAvailableActions().empty()
+                                            ? 0.0
+                                            : V.value(afterState);
+                        q += pieces.getProbability(p) *
+                             (immediateReward(outcomes[k][p]) + lambda * vAfter);
+                    }
+                    if (q > target)
+                    {
+                        target = q;
+                        greedy = k;
+                    }
+                }
+                if ((rand() / (double)RAND_MAX) < exploration)
+                {
+                    greedy = rand() % actions.size();
+                }
+                chosen = std::move(outcomes[greedy]);
+            }
+
+            std::vector<double> phi = LinearValue::features(curr);
+            for (int a = 0; a < d; a++)
+            {
+                for (int b = 0; b < d; b++)
+                {
+                    A[a][b] += phi[a] * phi[b];
+                }
+                A[a][d] += phi[a] * target;
+            }
+
+            length++;
+            if (chosen.empty() || length >= MAX_ACTION)
+            {
+                curr = s0_.clone();
+                curr.setNextTromino(Tromino(pieces.draw()));
+                length = 0;
+            }
+            else
+            {
+                State& placedState = chosen[pieces.draw()];
+                collected += immediateReward(placedState);
+                curr = placedState.completeLines();
+            }
+        }
+
+        if (collected / batchSize > bestReward)
+        {
+            bestReward = collected / batchSize;
+            best = V;
+        }
+
+        // a small ridge keeps features that never vary (e.g. a column
+        // always empty in the batch) from making the system singular
+        for (int a = 0; a < d; a++)
+        {
+            A[a][a] += 1e-6 * batchSize;
+        }
+        V.setWeights(solveLinearSystem(std::move(A)));
+
+        if (DEBUG)
+        {
+            std::cout << "i = " << i << " and reward per move = "
+                      << collected / batchSize << std::endl;
+        }
+    }
+    return best;
+}
+
+namespace
+{
+// State of the heuristic search, its actions and successors are generated
+// on the first backup
+struct SearchNode
+{
+    double value;
+    bool expanded = false;
+    bool solved = false;
+    int best = -1;
+    std::vector<Action> actions;
+    // per action then piece: immediate reward and state after completion
+    std::vector<double> rewards;
+    std::vector<std::pair<const State, SearchNode>*> next;
+};
+using SearchEntry = std::pair<const State, SearchNode>;
+
+// Labeled RTDP (Bonet and Geffner, 2003) on the discounted objective of
+// actionValueIteration. Values start at an upper bound of the optimal one,
+// so the greedy policy only explores states that may still be worth it and
+// a state is labeled solved once its whole greedy envelope has converged.
+class LabeledRTDP
+{
+  private:
+    std::unordered_map<State, SearchNode> nodes_;
+    double lambda_;
+    std::array<double, 4> weights_; // line, height, score, gap
+    double epsilon_;
+    double upper_;
+
+    SearchEntry* entry(const State& state)
+    {
+        auto it = nodes_.find(state);
+        if (it == nodes_.end())
+        {
+            it = nodes_.emplace(state.clone(), SearchNode()).first;
+            it->second.value = upper_;
+        }
+        return &*it;
+    }
+
+    void expand(SearchEntry* e)
+    {
+        const PieceSet& pieces = PieceSet::get();
+        SearchNode& node = e->second;
+        node.expanded = true;
+        node.actions = e->first.getAvailableActions();
+        if (node.actions.empty())
+        {
+            node.solved = true;
+            return;
+        }
+        // every state is expanded once and its successors are kept, so no
+        // scratch arena here
+        for (const Action& action : node.actions)
+        {
+            std::vector<State> placedStates =
+                e->first.genAllStatesFromAction(action);
+            for (int p = 0; p < pieces.size(); p++)
+            {
+                const State& placed = placedStates[p];
+                node.rewards.push_back(
+                    weights_[0] * placed.nbCompleteLines() -
+                    weights_[1] * placed.getField().getMaxHeight() +
+                    weights_[2] * placed.evaluate() -
+                    weights_[3] * placed.gapCheck());
+                node.next.push_back(entry(placed.completeLines()));
+            }
+        }
+    }
+
+    // Bellman backup of the state, returns the change of its value
+    double update(SearchEntry* e)
+    {
+        const PieceSet& pieces = PieceSet::get();
+        SearchNode& node = e->second;
+        if (!node.expanded)
+        {
+            expand(e);
+        }
+        if (node.actions.empty())
+        {
+            // the game is lost, the bound drops to 0
+            double residual = node.value;
+            node.value = 0.0;
+            return residual;
+        }
+        size_t nbPieces = pieces.size();
+        double best = -DBL_MAX;
+        for (size_t k = 0; k < node.actions.size(); k++)
+        {
+            double q = 0.0;
+            for (size_t p = 0; p < nbPieces; p++)
+            {
+                size_t t = k * nbPieces + p;
+                q += pieces.getProbability(p) *
+                     (node.rewards[t] + lambda_ * node.next[t]->second.value);
+            }
+            if (q > best)
+            {
+                best = q;
+                node.best = k;
+            }
+        }
+        double residual = std::abs(best - node.value);
+        node.value = best;
+        return residual;
+    }
+
+    bool checkSolved(SearchEntry* e)
+    {
+        size_t nbPieces = PieceSet::get().size();
+        bool converged = true;
+        std::vector<SearchEntry*> open, closed;
+        std::unordered_set<SearchEntry*> seen = {e};
+        if (!e->second.solved)
+        {
+            open.push_back(e);
+        }
+        while (!open.empty())
+        {
+            SearchEntry* s = open.back();
+            open.pop_back();
+            closed.push_back(s);
+            if (update(s) > epsilon_)
+            {
+                converged = false;
+                continue;
+            }
+            SearchNode& node = s->second;
+            for (size_t p = 0; p < nbPieces && !node.actions.empty(); p++)
+            {
+                SearchEntry* next = node.next[node.best * nbPieces + p];
+                if (!next->second.solved && seen.insert(next).second)
+                {
+                    open.push_back(next);
+                }
+            }
+        }
+        for (SearchEntry* s : closed)
+        {
+            s->second.solved = converged;
+        }
+        return converged;
+    }
+
+  public:
+    LabeledRTDP(double lambda,
+                std::array<double, 4> weights,
+                double epsilon,
+                int width,
+                int height)
+        : lambda_(lambda), weights_(weights), epsilon_(epsilon)
+    {
+        // a piece completes at most as many lines as it spans
+        int maxLines = 0;
+        for (int p = 0; p < PieceSet::get().size(); p++)
+        {
+            Tromino piece(p);
+            for (int r = 0; r < piece.rotationCount(); r++)
+            {
+                int top = height, bottom = 0;
+                for (const Offset& off : piece.getOffsets(r))
+                {
+                    top = std::min(top, off[0]);
+                    bottom = std::max(bottom, off[0]);
+                }
+                maxLines = std::max(maxLines, bottom - top + 1);
+            }
+        }
+        maxLines = std::min(maxLines, height);
+        const int lineScores[] = {0, SCORE_1_LINE, SCORE_2_LINES,
+                                  SCORE_3_LINES, SCORE_4_LINES};
+
+        // largest reward of a single move, then of the whole game
+        double maxReward =
+            std::max(0.0, weights[0]) * maxLines +
+            std::max(0.0, -weights[1]) * height +
+            std::max(0.0, weights[2]) * lineScores[std::min(maxLines, 4)] +
+            std::max(0.0, -weights[3]) * width * height;
+        upper_ = maxReward / (1.0 - lambda);
+    }
+
+    // one greedy walk from root with random pieces, then labeling
+    // backwards; returns whether root is solved
+    bool trial(const State& root)
+    {
+        const PieceSet& pieces = PieceSet::get();
+        std::vector<SearchEntry*> visited;
+        SearchEntry* s = entry(root);
+        for (int depth = 0; depth < MAX_ACTION && !s->second.solved; depth++)
+        {
+            visited.push_back(s);
+            update(s);
+            if (s->second.actions.empty())
+            {
+                break;
+            }
+            s = s->second.next[s->second.best * pieces.size() + pieces.draw()];
+        }
+        while (!visited.empty())
+        {
+            SearchEntry* last = visited.back();
+            visited.pop_back();
+            if (!checkSolved(last))
+            {
+                break;
+            }
+        }
+        return entry(root)->second.solved;
+    }
+
+    size_t nbExpanded() const
+    {
+        size_t count = 0;
+        for (const auto& [state, node] : nodes_)
+        {
+            count += node.expanded;
+        }
+        return count;
+    }
+
+    // greedy action of every expanded state
+    std::unordered_map<State, Action> policy() const
+    {
+        std::unordered_map<State, Action> A;
+        for (const auto& [state, node] : nodes_)
+        {
+            if (node.best >= 0)
+            {
+                A.emplace(state.clone(), node.actions[node.best]);
+            }
+        }
+        return A;
+    }
+};
+} // namespace
+
+std::unordered_map<State, Action> MDP::heuristicSearch(double lambda,
+                                                       double line_weight,
+                                                       double height_weight,
+                                                       double score_weight,
+                                                       double gap_reduction,
+                                                       double epsilon,
+                                                       int maxTrials)
+{
+    if (DEBUG)
+    {
+        std::cout << "Labeled RTDP from s0" << std::endl;
+    }
+    if (lambda >= 1.0)
+    {
+        std::cerr << "ERROR (heuristicSearch): the upper bound needs lambda < 1"
+                  << std::endl;
+        exit(1);
+    }
+    LabeledRTDP search(
+        lambda, {line_weight, height_weight, score_weight, gap_reduction},
+        epsilon, width_, height_);
+
+    // the first piece is drawn at random, as in the state graph
+    std::vector<State> roots;
+    roots.push_back(s0_.clone());
+    for (int p = 0; p < PieceSet::get().size(); p++)
+    {
+        roots.push_back(s0_.clone());
+        roots.back().setNextTromino(Tromino(p));
+    }
+
+    int trials = 0;
+    for (const State& root : roots)
+    {
+        while (trials < maxTrials && !search.trial(root))
+        {
+            trials++;
+        }
+    }
+
+    if (DEBUG)
+    {
+        std::cout << trials << " trials, " << search.nbExpanded()
+                  << " states expanded" << std::endl;
+    }
+    return search.policy();
 }
 
 std::unordered_map<State, Action> MDP::robustActionValueIterationMaxMin(
@@ -111,6 +914,7 @@ std::unordered_map<State, Action> MDP::robustActionValueIterationMaxMin(
 
     for (int i = 0; i < maxIteration && delta > epsilon; i++)
     {
+        PROFILE_SCOPE(PROF_SWEEP);
         delta = 0.0;
         for (auto& [currState, currValue] : V)
         {
@@ -125,39 +929,42 @@ std::unordered_map<State, Action> MDP::robustActionValueIterationMaxMin(
 
             std::vector<double> robust_action_values(nbActions);
 
-            for (int k = 0; k < nbActions; k++)
             {
-                double min_reward_for_action = DBL_MAX;
-
-                if (currState.genAllStatesFromAction(actions[k]).empty())
-                {
-                    continue;
-                }
-
-                for (State& placedState :
-                     currState.genAllStatesFromAction(actions[k]))
+                Arena::Scope scratch(Arena::local());
+                for (int k = 0; k < nbActions; k++)
                 {
-                    State afterState = placedState.completeLines();
+                    double min_reward_for_action = DBL_MAX;
 
-                    auto it = V.find(afterState);
-                    if (it == V.end())
+                    if (currState.genAllStatesFromAction(actions[k]).empty())
                     {
-                        std::cerr << "ERROR (robustActionValueIteration): the "
-                                     "state cannot be derived into "
-                                     "a non-reachable state"
-                                  << std::endl;
-                        exit(1);
+                        continue;
                     }
-                    double vAfter = it->second;
 
-                    double reward = placedState.evaluate() + lambda * vAfter;
-
-                    if (reward < min_reward_for_action)
+                    for (State& placedState :
+                         currState.genAllStatesFromAction(actions[k]))
                     {
-                        min_reward_for_action = reward;
+                        State afterState = placedState.completeLines();
+
+                        auto it = lookup(V, afterState);
+                        if (it == V.end())
+                        {
+                            std::cerr << "ERROR (robustActionValueIteration): the "
+                                         "state cannot be derived into "
+                                         "a non-reachable state"
+                                      << std::endl;
+                            exit(1);
+                        }
+                        double vAfter = it->second;
+
+                        double reward = placedState.evaluate() + lambda * vAfter;
+
+                        if (reward < min_reward_for_action)
+                        {
+                            min_reward_for_action = reward;
+                        }
                     }
+                    robust_action_values[k] = min_reward_for_action;
                 }
-                robust_action_values[k] = min_reward_for_action;
             }
 
             vPrime = *std::max_element(robust_action_values.begin(),
@@ -167,13 +974,13 @@ std::unordered_map<State, Action> MDP::robustActionValueIterationMaxMin(
             {
                 if (vPrime == robust_action_values[k])
                 {
-                    A.insert_or_assign(currState.clone(), actions[k]);
+                    assign(A, currState, actions[k]);
                     break;
                 }
             }
 
             delta = std::max(delta, std::abs(vPrime - currValue));
-            V.insert_or_assign(currState.clone(), vPrime);
+            currValue = vPrime;
         }
 
         if (DEBUG)
@@ -195,6 +1002,60 @@ std::unordered_map<State, Action> MDP::robustActionValueIterationMaxMin(
     return A;
 }
 
+GameSolution MDP::gameValueIteration(double epsilon,
+                                     int maxIteration,
+                                     double lambda)
+{
+    if (DEBUG)
+    {
+        std::cout << "Player/Adversary Game Value Iteration" << std::endl;
+    }
+    const StateGraph& graph = getGraph();
+    int nbStates = graph.size();
+
+    // the player moves first (max over actions), then the adversary picks
+    // the next piece knowing the action (min over pieces)
+    std::vector<double> V(nbStates, 0.0);
+    std::vector<int> bestAction(nbStates, -1);
+    std::vector<int> worstPiece(nbStates, -1);
+
+    // a transition is worth its score plus the discounted successor value
+    size_t nbTransitions = graph.getTransitions().size();
+    std::vector<double> scores(nbTransitions);
+    for (size_t t = 0; t < nbTransitions; t++)
+    {
+        scores[t] = graph.getTransitions()[t].score;
+    }
+    BellmanBackup backup(graph, std::move(scores),
+                         std::vector<double>(nbTransitions, lambda));
+
+    double delta = DBL_MAX;
+    for (int i = 0; i < maxIteration && delta > epsilon; i++)
+    {
+        delta = backup.minMax(V, bestAction, worstPiece);
+
+        if (DEBUG)
+        {
+            std::cout << "i = " << i << " and delta = " << delta << std::endl;
+        }
+    }
+
+    GameSolution solution;
+    solution.value = V[graph.find(s0_.key())];
+    for (int s = 0; s < nbStates; s++)
+    {
+        if (bestAction[s] < 0)
+        {
+            continue;
+        }
+        solution.actions.emplace(graph.getState(s),
+                                 graph.getAction(bestAction[s]));
+        solution.trominos.emplace(graph.getState(s),
+                                  std::make_unique<Tromino>(worstPiece[s]));
+    }
+    return solution;
+}
+
 std::unordered_map<State, std::unique_ptr<Tromino>>
 MDP::trominoValueIterationMinMax(double epsilon,
                                  int maxIteration,
@@ -208,11 +1069,13 @@ MDP::trominoValueIterationMinMax(double epsilon,
 
     std::unordered_map<State, std::unique_ptr<Tromino>> T;
 
-    double delta, maxI, maxL, reward, vPrime, vAfter;
+    double delta, reward, vPrime, vAfter;
+    std::vector<double> maxPerPiece(PieceSet::get().size());
     delta = DBL_MAX;
 
     for (int i = 0; i < maxIteration && delta > epsilon; i++)
     {
+        PROFILE_SCOPE(PROF_SWEEP);
         delta = 0.0;
         for (auto& [currState, currValue] : V)
         {
@@ -225,54 +1088,44 @@ MDP::trominoValueIterationMinMax(double epsilon,
                 continue;
             }
 
-            maxI = maxL = 0.0;
-            for (int k = 0; k < nbActions; k++)
+            std::fill(maxPerPiece.begin(), maxPerPiece.end(), 0.0);
             {
-                for (State& placedState :
-                     currState.genAllStatesFromAction(actions[k]))
+                Arena::Scope scratch(Arena::local());
+                for (int k = 0; k < nbActions; k++)
                 {
-                    State afterState = placedState.completeLines();
-
-                    auto it = V.find(afterState);
-                    if (it == V.end())
-                    {
-                        std::cerr << "ERROR (trominoValueIteration): the "
-                                     "state cannot be derived into "
-                                     "a non-reachable state"
-                                  << std::endl;
-                        exit(1);
-                    }
-                    vAfter = it->second;
-
-                    reward = placedState.evaluate() + lambda * vAfter;
-
-                    const Tromino* t = &afterState.getNextTromino();
-                    if (dynamic_cast<const LPiece*>(t) != nullptr)
-                    {
-                        maxL = reward > maxL ? reward : maxL;
-                    }
-                    else if (dynamic_cast<const IPiece*>(t) != nullptr)
+                    for (State& placedState :
+                         currState.genAllStatesFromAction(actions[k]))
                     {
-                        maxI = reward > maxI ? reward : maxI;
+                        State afterState = placedState.completeLines();
+
+                        auto it = lookup(V, afterState);
+                        if (it == V.end())
+                        {
+                            std::cerr << "ERROR (trominoValueIteration): the "
+                                         "state cannot be derived into "
+                                         "a non-reachable state"
+                                      << std::endl;
+                            exit(1);
+                        }
+                        vAfter = it->second;
+
+                        reward = placedState.evaluate() + lambda * vAfter;
+
+                        int p = afterState.getNextTromino().getType();
+                        maxPerPiece[p] = std::max(maxPerPiece[p], reward);
                     }
                 }
             }
-            if (maxL < maxI)
-            {
-                T.insert_or_assign(currState.clone(),
-                                   std::make_unique<LPiece>());
-                vPrime = maxL;
-            }
-            else
-            {
-                T.insert_or_assign(currState.clone(),
-                                   std::make_unique<IPiece>());
-                vPrime = maxI;
-            }
+            // the piece whose best placement is the worst one
+            int worst = std::min_element(maxPerPiece.begin(),
+                                         maxPerPiece.end()) -
+                        maxPerPiece.begin();
+            assign(T, currState, std::make_unique<Tromino>(worst));
+            vPrime = maxPerPiece[worst];
 
             delta = std::max(delta, std::abs(vPrime - currValue));
 
-            V.insert_or_assign(currState.clone(), vPrime);
+            currValue = vPrime;
         }
 
         if (DEBUG)
@@ -301,11 +1154,13 @@ MDP::trominoValueIterationGapAvg(double epsilon,
 {
     std::unordered_map<State, double> V = generateReachableStates(s0_.clone());
     std::unordered_map<State, std::unique_ptr<Tromino>> T;
-    double delta, reward, vPrime, vAfter, avgI, avgL;
+    double delta, reward, vPrime, vAfter;
+    std::vector<double> avgPerPiece(PieceSet::get().size());
     delta = DBL_MAX;
 
     for (int i = 0; i < maxIteration && delta > epsilon; i++)
     {
+        PROFILE_SCOPE(PROF_SWEEP);
         delta = 0.0;
         for (auto& [currState, currValue] : V)
         {
@@ -317,57 +1172,53 @@ MDP::trominoValueIterationGapAvg(double epsilon,
             {
                 continue;
             }
-            avgI = avgL = 0.0;
-            for (int k = 0; k < nbActions; k++)
+            std::fill(avgPerPiece.begin(), avgPerPiece.end(), 0.0);
             {
-                for (State& placedState :
-                     currState.genAllStatesFromAction(actions[k]))
+                Arena::Scope scratch(Arena::local());
+                for (int k = 0; k < nbActions; k++)
                 {
-                    State afterState = placedState.completeLines();
-
-                    auto it = V.find(afterState);
-                    if (it == V.end())
-                    {
-                        std::cerr << "ERROR (trominoValueIterationGap): the "
-                                     "state cannot be derived into "
-                                     "a non-reachable state"
-                                  << std::endl;
-                        exit(1);
-                    }
-                    vAfter = it->second;
-
-                    reward = placedState.gapCheck() + lambda * vAfter;
-
-                    const Tromino* t = &afterState.getNextTromino();
-                    if (dynamic_cast<const LPiece*>(t) != nullptr)
-                    {
-                        avgL += reward;
-                    }
-                    else if (dynamic_cast<const IPiece*>(t) != nullptr)
+                    for (State& placedState :
+                         currState.genAllStatesFromAction(actions[k]))
                     {
-                        avgI += reward;
+                        State afterState = placedState.completeLines();
+
+                        auto it = lookup(V, afterState);
+                        if (it == V.end())
+                        {
+                            std::cerr << "ERROR (trominoValueIterationGap): the "
+                                         "state cannot be derived into "
+                                         "a non-reachable state"
+                                      << std::endl;
+                            exit(1);
+                        }
+                        vAfter = it->second;
+
+                        reward = placedState.gapCheck() + lambda * vAfter;
+
+                        avgPerPiece[afterState.getNextTromino().getType()] +=
+                            reward;
                     }
                 }
             }
             // max gap
-            avgI /= nbActions;
-            avgL /= nbActions;
-            if (avgL < avgI)
+            for (double& avg : avgPerPiece)
             {
-                T.insert_or_assign(currState.clone(),
-                                   std::make_unique<IPiece>());
-                vPrime = avgL;
+                avg /= nbActions;
             }
-            else
+            int worst = 0;
+            for (size_t p = 1; p < avgPerPiece.size(); p++)
             {
-                T.insert_or_assign(currState.clone(),
-                                   std::make_unique<LPiece>());
-                vPrime = avgI;
+                if (avgPerPiece[p] >= avgPerPiece[worst])
+                {
+                    worst = p;
+                }
             }
+            assign(T, currState, std::make_unique<Tromino>(worst));
+            vPrime = *std::min_element(avgPerPiece.begin(), avgPerPiece.end());
 
             delta = std::max(delta, std::abs(vPrime - currValue));
 
-            V.insert_or_assign(currState.clone(), vPrime);
+            currValue = vPrime;
         }
 
         if (DEBUG)
@@ -402,11 +1253,13 @@ MDP::trominoValueIterationMinAvg(double epsilon,
 
     std::unordered_map<State, std::unique_ptr<Tromino>> T;
 
-    double delta, reward, vPrime, vAfter, avgI, avgL;
+    double delta, reward, vPrime, vAfter;
+    std::vector<double> avgPerPiece(PieceSet::get().size());
     delta = DBL_MAX;
 
     for (int i = 0; i < maxIteration && delta > epsilon; i++)
     {
+        PROFILE_SCOPE(PROF_SWEEP);
         delta = 0.0;
         for (auto& [currState, currValue] : V)
         {
@@ -419,56 +1272,47 @@ MDP::trominoValueIterationMinAvg(double epsilon,
                 continue;
             }
 
-            avgI = avgL = 0.0;
-            for (int k = 0; k < nbActions; k++)
+            std::fill(avgPerPiece.begin(), avgPerPiece.end(), 0.0);
             {
-                for (State& placedState :
-                     currState.genAllStatesFromAction(actions[k]))
+                Arena::Scope scratch(Arena::local());
+                for (int k = 0; k < nbActions; k++)
                 {
-                    State afterState = placedState.completeLines();
-
-                    auto it = V.find(afterState);
-                    if (it == V.end())
-                    {
-                        std::cerr << "ERROR (trominoValueIteration): the "
-                                     "state cannot be derived into "
-                                     "a non-reachable state"
-                                  << std::endl;
-                        exit(1);
-                    }
-                    vAfter = it->second;
-
-                    reward = placedState.evaluate() + lambda * vAfter;
-
-                    const Tromino* t = &afterState.getNextTromino();
-                    if (dynamic_cast<const LPiece*>(t) != nullptr)
-                    {
-                        avgL += reward;
-                    }
-                    else if (dynamic_cast<const IPiece*>(t) != nullptr)
+                    for (State& placedState :
+                         currState.genAllStatesFromAction(actions[k]))
                     {
-                        avgI += reward;
+                        State afterState = placedState.completeLines();
+
+                        auto it = lookup(V, afterState);
+                        if (it == V.end())
+                        {
+                            std::cerr << "ERROR (trominoValueIteration): the "
+                                         "state cannot be derived into "
+                                         "a non-reachable state"
+                                      << std::endl;
+                            exit(1);
+                        }
+                        vAfter = it->second;
+
+                        reward = placedState.evaluate() + lambda * vAfter;
+
+                        avgPerPiece[afterState.getNextTromino().getType()] +=
+                            reward;
                     }
                 }
             }
-            avgI /= nbActions;
-            avgL /= nbActions;
-            if (avgL < avgI)
+            for (double& avg : avgPerPiece)
             {
-                T.insert_or_assign(currState.clone(),
-                                   std::make_unique<LPiece>());
-                vPrime = avgL;
-            }
-            else
-            {
-                T.insert_or_assign(currState.clone(),
-                                   std::make_unique<IPiece>());
-                vPrime = avgI;
+                avg /= nbActions;
             }
+            int worst = std::min_element(avgPerPiece.begin(),
+                                         avgPerPiece.end()) -
+                        avgPerPiece.begin();
+            assign(T, currState, std::make_unique<Tromino>(worst));
+            vPrime = avgPerPiece[worst];
 
             delta = std::max(delta, std::abs(vPrime - currValue));
 
-            V.insert_or_assign(currState.clone(), vPrime);
+            currValue = vPrime;
         }
 
         if (DEBUG)
@@ -490,57 +1334,246 @@ MDP::trominoValueIterationMinAvg(double epsilon,
     return T;
 }
 
-std::unordered_map<State, double> MDP::generateReachableStates(State s0)
+AdversarySolution
+MDP::adversaryValueIteration(double epsilon,
+                             int maxIteration,
+                             double lambda,
+                             int nbThreads)
 {
-    std::unordered_map<State, double> map;
-    std::vector<State> q;
-    size_t q_head = 0;
-
-    State s0_other = s0.clone();
-    const Tromino& current_tromino = s0_other.getNextTromino();
-    if (dynamic_cast<const IPiece*>(&current_tromino))
+    if (DEBUG)
     {
-        s0_other.setNextTromino(LPiece());
+        std::cout << "Fused Adversary Value Iteration" << std::endl;
     }
-    else
+    const StateGraph& graph = getGraph();
+    int n = graph.size();
+    int nbPieces = graph.getNbPieces();
+
+    // MinMax, MinAvg and GapAvg side by side, Jacobi sweeps so that the
+    // states can be split between threads
+    enum
     {
-        s0_other.setNextTromino(IPiece());
+        MIN_MAX,
+        MIN_AVG,
+        GAP_AVG,
+        NB_ADVERSARIES
+    };
+    std::vector<double> V[NB_ADVERSARIES], VOut[NB_ADVERSARIES];
+    std::vector<int> worst[NB_ADVERSARIES];
+    double delta[NB_ADVERSARIES];
+    for (int o = 0; o < NB_ADVERSARIES; o++)
+    {
+        V[o].assign(n, 0.0);
+        VOut[o].assign(n, 0.0);
+        worst[o].assign(n, -1);
+        delta[o] = DBL_MAX;
     }
 
-    q.push_back(s0.clone());
-    map.emplace(std::move(s0), 0);
+    int nbWorkers = workersFor(n, std::max(1, nbThreads));
+    std::vector<std::array<double, NB_ADVERSARIES>> workerDelta(nbWorkers);
 
-    if (map.find(s0_other) == map.end())
+    auto sweepSlice = [&](int w)
     {
-        q.push_back(s0_other.clone());
-        map.emplace(std::move(s0_other), 0);
-    }
+        PROFILE_SCOPE(PROF_SWEEP);
+        std::vector<double> best(nbPieces), avg(nbPieces), gap(nbPieces);
+        workerDelta[w].fill(0.0);
+        int begin = (int64_t)n * w / nbWorkers;
+        int end = (int64_t)n * (w + 1) / nbWorkers;
+        for (int s = begin; s < end; s++)
+        {
+            int nbActions = graph.actionEnd(s) - graph.actionBegin(s);
+            if (nbActions == 0)
+            {
+                continue;
+            }
 
-    while (q_head < q.size())
-    {
-        State currState = std::move(q[q_head]);
-        q_head++;
+            std::fill(best.begin(), best.end(), 0.0);
+            std::fill(avg.begin(), avg.end(), 0.0);
+            std::fill(gap.begin(), gap.end(), 0.0);
+            for (int k = graph.actionBegin(s); k < graph.actionEnd(s); k++)
+            {
+                for (int p = 0; p < nbPieces; p++)
+                {
+                    const Transition& t = graph.getTransition(k, p);
+                    best[p] = std::max(best[p],
+                                       t.score + lambda * V[MIN_MAX][t.next]);
+                    avg[p] += t.score + lambda * V[MIN_AVG][t.next];
+                    gap[p] += t.gaps + lambda * V[GAP_AVG][t.next];
+                }
+            }
+            for (int p = 0; p < nbPieces; p++)
+            {
+                avg[p] /= nbActions;
+                gap[p] /= nbActions;
+            }
 
-        for (const Action& a : currState.getAvailableActions())
-        {
-            for (auto& nextState : currState.genAllStatesFromAction(a))
+            // same choices as the three map solvers: the piece whose best
+            // placement is the worst, the lowest average score and the
+            // highest average gap count (last one on ties)
+            double vPrime[NB_ADVERSARIES];
+            int chosen[NB_ADVERSARIES];
+            chosen[MIN_MAX] =
+                std::min_element(best.begin(), best.end()) - best.begin();
+            vPrime[MIN_MAX] = best[chosen[MIN_MAX]];
+            chosen[MIN_AVG] =
+                std::min_element(avg.begin(), avg.end()) - avg.begin();
+            vPrime[MIN_AVG] = avg[chosen[MIN_AVG]];
+            chosen[GAP_AVG] = 0;
+            for (int p = 1; p < nbPieces; p++)
             {
-                State finalNextState = nextState.completeLines();
-                if (map.find(finalNextState) == map.end())
+                if (gap[p] >= gap[chosen[GAP_AVG]])
                 {
-                    q.push_back(finalNextState.clone());
-                    map.emplace(std::move(finalNextState), 0.0);
+                    chosen[GAP_AVG] = p;
                 }
             }
+            vPrime[GAP_AVG] = *std::min_element(gap.begin(), gap.end());
+
+            for (int o = 0; o < NB_ADVERSARIES; o++)
+            {
+                // a converged adversary stops moving, as its own solver would
+                if (delta[o] <= epsilon)
+                {
+                    VOut[o][s] = V[o][s];
+                    continue;
+                }
+                worst[o][s] = chosen[o];
+                VOut[o][s] = vPrime[o];
+                workerDelta[w][o] = std::max(workerDelta[w][o],
+                                             std::abs(vPrime[o] - V[o][s]));
+            }
+        }
+    };
+
+    WorkerPool workers(nbWorkers);
+    for (int i = 0; i < maxIteration; i++)
+    {
+        workers.run(sweepSlice);
+
+        bool converged = true;
+        for (int o = 0; o < NB_ADVERSARIES; o++)
+        {
+            if (delta[o] <= epsilon)
+            {
+                continue;
+            }
+            delta[o] = 0.0;
+            for (const auto& d : workerDelta)
+            {
+                delta[o] = std::max(delta[o], d[o]);
+            }
+            V[o].swap(VOut[o]);
+            converged = converged && delta[o] <= epsilon;
+        }
+
+        if (DEBUG)
+        {
+            std::cout << "i = " << i << " and delta = " << delta[MIN_MAX]
+                      << " " << delta[MIN_AVG] << " " << delta[GAP_AVG]
+                      << std::endl;
+        }
+        if (converged)
+        {
+            break;
+        }
+    }
+
+    AdversarySolution solution;
+    std::unordered_map<State, std::unique_ptr<Tromino>>* maps[] = {
+        &solution.minMax, &solution.minAvg, &solution.gapAvg};
+    for (int s = 0; s < n; s++)
+    {
+        if (worst[MIN_MAX][s] < 0)
+        {
+            continue;
+        }
+        for (int o = 0; o < NB_ADVERSARIES; o++)
+        {
+            maps[o]->emplace(graph.getState(s),
+                             std::make_unique<Tromino>(worst[o][s]));
         }
     }
+    return solution;
+}
+
+std::unordered_map<State, double> MDP::generateReachableStates(State s0)
+{
+    std::shared_ptr<const StateGraph> graph;
+    if (s0 == s0_)
+    {
+        graph = getSharedGraph();
+    }
+    else
+    {
+        graph = std::make_shared<StateGraph>(
+            s0, std::thread::hardware_concurrency());
+    }
+
+    std::unordered_map<State, double> map;
+    map.reserve(graph->size());
+    for (int id = 0; id < graph->size(); id++)
+    {
+        map.emplace(graph->getState(id), 0.0);
+    }
     return map;
 }
 
+const StateGraph& MDP::getGraph() { return *getSharedGraph(); }
+
+std::shared_ptr<const StateGraph> MDP::getSharedGraph()
+{
+    if (!graph_)
+    {
+        graph_ = std::make_shared<StateGraph>(
+            s0_, std::thread::hardware_concurrency());
+        if (DEBUG)
+        {
+            std::cout << graph_->size() << " reachable states and "
+                      << graph_->nbActions() << " actions" << std::endl;
+        }
+    }
+    return graph_;
+}
+
+namespace
+{
+// Player reading its actions from a solved policy
+class TablePlayer : public Player
+{
+  private:
+    const std::unordered_map<State, Action>& policy_;
+
+  public:
+    TablePlayer(const std::unordered_map<State, Action>& policy)
+        : policy_(policy) {};
+
+    Action chooseAction(const State& curr) override
+    {
+        auto itAction = policy_.find(curr);
+        if (itAction == policy_.end())
+        {
+            std::cerr << "ERROR the state:\n"
+                      << curr << std::endl
+                      << "haven't any associated action in the provided policy"
+                      << std::endl;
+            exit(1);
+        }
+        return itAction->second;
+    }
+};
+} // namespace
+
 int MDP::playPolicy(
     Game& game,
     const std::unordered_map<State, Action>& policy,
     const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy)
+{
+    TablePlayer player(policy);
+    return playPolicy(game, player, advPolicy);
+}
+
+int MDP::playPolicy(
+    Game& game,
+    Player& player,
+    const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy)
 {
     // maybe use the tromino policy to fix the very first Tromino
     game.setState(s0_.clone());
@@ -553,14 +1586,7 @@ int MDP::playPolicy(
     auto itTromino = advPolicy.find(curr);
     if (itTromino == advPolicy.end())
     {
-        if ((rand() / (double)RAND_MAX) < PROBA_I_PIECE)
-        {
-            t_owned = std::make_unique<IPiece>();
-        }
-        else
-        {
-            t_owned = std::make_unique<LPiece>();
-        }
+        t_owned = std::make_unique<Tromino>(PieceSet::get().draw());
         t_ptr = &t_owned;
     }
     else
@@ -571,21 +1597,14 @@ int MDP::playPolicy(
     game.getState().setNextTromino(*t);
 
     int nbAction = 0, gain;
+    bool tracing = TraceRecorder::enabled();
+    uint32_t traceGame = tracing ? TraceRecorder::beginGame() : 0;
 
     while (game.getState().getAvailableActions().size() > 0 &&
            nbAction < MAX_ACTION)
     {
         State& curr = game.getState();
-        auto itAction = policy.find(curr);
-        if (itAction == policy.end())
-        {
-            std::cerr << "ERROR the state:\n"
-                      << curr << std::endl
-                      << "haven't any associated action in the provided policy"
-                      << std::endl;
-            exit(1);
-        }
-        const Action& a = itAction->second;
+        Action a = player.chooseAction(curr);
 
         const std::unique_ptr<Tromino>* t_ptr;
         std::unique_ptr<Tromino> t_owned;
@@ -593,14 +1612,7 @@ int MDP::playPolicy(
         auto itTromino = advPolicy.find(curr);
         if (itTromino == advPolicy.end())
         {
-            if ((rand() / (double)RAND_MAX) < PROBA_I_PIECE)
-            {
-                t_owned = std::make_unique<IPiece>();
-            }
-            else
-            {
-                t_owned = std::make_unique<LPiece>();
-            }
+            t_owned = std::make_unique<Tromino>(PieceSet::get().draw());
             t_ptr = &t_owned;
         }
         else
@@ -616,6 +1628,10 @@ int MDP::playPolicy(
         // prettyPrint(curr, placed.clone(), after.clone());
 
         gain = placed.evaluate();
+        if (tracing)
+        {
+            TraceRecorder::record(traceGame, curr, a, t->getType(), gain);
+        }
 
         game.setScore(game.getScore() + gain);
 
@@ -632,6 +1648,30 @@ int MDP::playPolicy(
     return game.getScore();
 }
 
+CompiledPolicy
+MDP::compilePolicy(const std::unordered_map<State, Action>& policy)
+{
+    return CompiledPolicy(getGraph(), s0_, policy);
+}
+
+std::vector<int8_t> MDP::compileAdversary(
+    const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy)
+{
+    return CompiledPolicy::compileAdversary(getGraph(), advPolicy);
+}
+
+CompactPolicy
+MDP::compactPolicy(const std::unordered_map<State, Action>& policy)
+{
+    return CompactPolicy(getGraph(), policy);
+}
+
+CompactAdversary MDP::compactAdversary(
+    const std::unordered_map<State, std::unique_ptr<Tromino>>& advPolicy)
+{
+    return CompactAdversary(getGraph(), advPolicy);
+}
+
 void MDP::prettyPrint(State& curr, State placed, State after)
 {
     // pretty-print three fields side-by-side with connectors
@@ -642,7 +1682,7 @@ void MDP::prettyPrint(State& curr, State placed, State after)
         {
             std::string line;
             for (int c = 0; c < f.getWidth(); ++c)
-                line.push_back(f.getGrid()[r][c] ? '*' : '.');
+                line.push_back(f.isFilled(r, c) ? '*' : '.');
             out.push_back(line);
         }
         return out;
@@ -685,23 +1725,77 @@ void MDP::prettyPrint(State& curr, State placed, State after)
     }
 }
 
-int MDP::getMaxHeight(const Field& field) const
+std::vector<double> MDP::transitionRewards(const StateGraph& graph,
+                                           double line_weight,
+                                           double height_weight,
+                                           double score_weight,
+                                           double gap_reduction) const
+{
+    // immediate rewards already weighted by the piece probabilities
+    const std::vector<Transition>& transitions = graph.getTransitions();
+    const PieceSet& pieces = PieceSet::get();
+    std::vector<double> rewards(transitions.size());
+    for (size_t t = 0; t < transitions.size(); t++)
+    {
+        const Transition& tr = transitions[t];
+        double immediate_reward =
+            (line_weight * tr.lines) - (height_weight * tr.height) +
+            (score_weight * tr.score) - (gap_reduction * tr.gaps);
+        rewards[t] =
+            pieces.getProbability(t % graph.getNbPieces()) * immediate_reward;
+    }
+    return rewards;
+}
+
+std::vector<double> MDP::transitionCoefficients(const StateGraph& graph,
+                                               double lambda) const
+{
+    // discounted probability of each successor
+    const PieceSet& pieces = PieceSet::get();
+    std::vector<double> coefs(graph.getTransitions().size());
+    for (size_t t = 0; t < coefs.size(); t++)
+    {
+        coefs[t] = pieces.getProbability(t % graph.getNbPieces()) * lambda;
+    }
+    return coefs;
+}
+
+std::unordered_map<State, Action>
+MDP::toActionMap(const StateGraph& graph, const std::vector<int>& policy) const
 {
-    int maxHeight = 0;
-    for (int c = 0; c < field.getWidth(); ++c)
+    std::unordered_map<State, Action> A;
+    A.reserve(graph.size());
+    for (int s = 0; s < graph.size(); s++)
     {
-        for (int r = 0; r < field.getHeight(); ++r)
+        if (policy[s] >= 0)
         {
-            if (field.getGrid()[r][c])
-            {
-                int height = field.getHeight() - r;
-                if (height > maxHeight)
-                {
-                    maxHeight = height;
-                }
-                break;
-            }
+            A.emplace(graph.getState(s), graph.getAction(policy[s]));
         }
     }
-    return maxHeight;
+    return A;
+}
+
+int MDP::getMaxHeight(const Field& field) const
+{
+    return field.getMaxHeight();
+}
+
+Checkpoint MDP::snapshot(const std::unordered_map<State, double>& V,
+                         const std::unordered_map<State, Action>& A,
+                         int iteration,
+                         double delta) const
+{
+    Checkpoint checkpoint{width_, height_, PieceSet::get().size(),
+                          iteration,   delta, {}, {}, {}};
+    checkpoint.keys.reserve(V.size());
+    checkpoint.values.reserve(V.size());
+    checkpoint.actions.reserve(V.size());
+    for (const auto& [state, value] : V)
+    {
+        checkpoint.keys.push_back(state.key());
+        checkpoint.values.push_back(value);
+        auto it = A.find(state);
+        checkpoint.actions.push_back(it == A.end() ? Action() : it->second);
+    }
+    return checkpoint;
 }
@@ -0,0 +1,77 @@
+#include "PieceSet.h"
+#include <cstdlib>
+#include <iostream>
+
+static PieceSet g_pieces = PieceSet::trominoes();
+
+PieceSet::PieceSet(std::vector<PieceShape> shapes,
+                   std::vector<double> probabilities)
+    : shapes_(std::move(shapes)), probabilities_(std::move(probabilities))
+{
+    if (shapes_.empty() || shapes_.size() != probabilities_.size())
+    {
+        std::cerr << "ERROR (PieceSet): expected one probability per piece"
+                  << std::endl;
+        exit(1);
+    }
+}
+
+int PieceSet::draw() const
+{
+    double r = rand() / (double)RAND_MAX;
+    for (int p = 0; p < size() - 1; p++)
+    {
+        if (r < probabilities_[p])
+        {
+            return p;
+        }
+        r -= probabilities_[p];
+    }
+    return size() - 1;
+}
+
+PieceSet PieceSet::trominoes()
+{
+    return PieceSet(
+        {{"IPiece",
+          {{{0, 0}, {0, 1}, {0, 2}},   // horizontal
+           {{0, 0}, {1, 0}, {2, 0}}}}, // vertical
+         {"LPiece",
+          {{{0, 1}, {1, 0}, {1, 1}},    // missing top-left
+           {{0, 0}, {1, 0}, {1, 1}},    // missing top-right
+           {{0, 0}, {0, 1}, {1, 0}},    // missing bottom-right
+           {{0, 0}, {0, 1}, {1, 1}}}}}, // missing bottom-left
+        {PROBA_I_PIECE, 1.0 - PROBA_I_PIECE});
+}
+
+PieceSet PieceSet::tetrominoes()
+{
+    return PieceSet(
+        {{"ITetromino",
+          {{{0, 0}, {0, 1}, {0, 2}, {0, 3}}, {{0, 0}, {1, 0}, {2, 0}, {3, 0}}}},
+         {"OTetromino", {{{0, 0}, {0, 1}, {1, 0}, {1, 1}}}},
+         {"TTetromino",
+          {{{0, 0}, {0, 1}, {0, 2}, {1, 1}},
+           {{0, 1}, {1, 0}, {1, 1}, {2, 1}},
+           {{0, 1}, {1, 0}, {1, 1}, {1, 2}},
+           {{0, 0}, {1, 0}, {1, 1}, {2, 0}}}},
+         {"STetromino",
+          {{{0, 1}, {0, 2}, {1, 0}, {1, 1}}, {{0, 0}, {1, 0}, {1, 1}, {2, 1}}}},
+         {"ZTetromino",
+          {{{0, 0}, {0, 1}, {1, 1}, {1, 2}}, {{0, 1}, {1, 0}, {1, 1}, {2, 0}}}},
+         {"JTetromino",
+          {{{0, 0}, {1, 0}, {1, 1}, {1, 2}},
+           {{0, 0}, {0, 1}, {1, 0}, {2, 0}},
+           {{0, 0}, {0, 1}, {0, 2}, {1, 2}},
+           {{0, 1}, {1, 1}, {2, 0}, {2, 1}}}},
+         {"LTetromino",
+          {{{0, 2}, {1, 0}, {1, 1}, {1, 2}},
+           {{0, 0}, {1, 0}, {2, 0}, {2, 1}},
+           {{0, 0}, {0, 1}, {0, 2}, {1, 0}},
+           {{0, 0}, {0, 1}, {1, 1}, {2, 1}}}}},
+        std::vector<double>(7, 1.0 / 7));
+}
+
+const PieceSet& PieceSet::get() { return g_pieces; }
+
+void PieceSet::set(PieceSet pieces) { g_pieces = std::move(pieces); }
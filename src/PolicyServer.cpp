@@ -0,0 +1,405 @@
+#include "PolicyServer.h"
+#include "CompiledPolicy.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define POLICY_TABLE_MAGIC 0x4c4f5054 // "TPOL"
+#define POLICY_TABLE_VERSION 1
+#define LISTEN_BACKLOG 128
+#define READ_CHUNK 65536
+// input buffered for a client, at least the largest request
+#define MAX_PENDING_INPUT \
+    (sizeof(uint32_t) + MAX_QUERY_BATCH * sizeof(uint64_t))
+
+static_assert(sizeof(PolicyAnswer) == 4, "answers are 4 bytes");
+
+namespace
+{
+sockaddr_un socketAddress(const std::string& path, const char* who)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "ERROR (" << who << "): socket path too long: " << path
+                  << std::endl;
+        exit(1);
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+} // namespace
+
+void writePolicyTable(const std::string& path,
+                      const StateGraph& graph,
+                      const CompactPolicy& policy,
+                      const std::vector<int8_t>& adversary)
+{
+    std::vector<int32_t> order(graph.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int32_t a, int32_t b)
+              { return graph.getKey(a) < graph.getKey(b); });
+
+    std::vector<uint64_t> keys;
+    std::vector<PolicyAnswer> answers;
+    for (int32_t s : order)
+    {
+        PolicyAnswer answer = {0, 0, NO_ANSWER_ACTION, adversary[s]};
+        int k = policy.getActionId(graph, s);
+        if (k >= 0)
+        {
+            const Action& a = graph.getAction(k);
+            answer.line = a.getPosition().getX();
+            answer.column = a.getPosition().getY();
+            answer.rotation = a.getRotation();
+        }
+        keys.push_back(graph.getKey(s));
+        answers.push_back(answer);
+    }
+
+    PolicyTable::Header header = {POLICY_TABLE_MAGIC,
+                                  POLICY_TABLE_VERSION,
+                                  graph.getWidth(),
+                                  graph.getHeight(),
+                                  graph.getNbPieces(),
+                                  0,
+                                  keys.size()};
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(keys.data()),
+              keys.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(answers.data()),
+              answers.size() * sizeof(PolicyAnswer));
+    if (!out)
+    {
+        std::cerr << "ERROR (writePolicyTable): cannot write " << path
+                  << std::endl;
+        exit(1);
+    }
+}
+
+PolicyTable::PolicyTable(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+    {
+        std::cerr << "ERROR (PolicyTable): cannot read " << path << std::endl;
+        exit(1);
+    }
+    bytes_ = st.st_size;
+    data_ = mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data_ == MAP_FAILED)
+    {
+        std::cerr << "ERROR (PolicyTable): cannot map " << path << std::endl;
+        exit(1);
+    }
+
+    header_ = static_cast<const Header*>(data_);
+    keys_ = reinterpret_cast<const uint64_t*>(header_ + 1);
+    answers_ = reinterpret_cast<const PolicyAnswer*>(keys_ + header_->nbStates);
+    if (header_->magic != POLICY_TABLE_MAGIC ||
+        header_->version != POLICY_TABLE_VERSION ||
+        bytes_ != sizeof(Header) + header_->nbStates * (sizeof(uint64_t) +
+                                                        sizeof(PolicyAnswer)))
+    {
+        std::cerr << "ERROR (PolicyTable): " << path
+                  << " is not a policy table of this version" << std::endl;
+        exit(1);
+    }
+}
+
+PolicyTable::~PolicyTable() { munmap(data_, bytes_); }
+
+PolicyAnswer PolicyTable::query(uint64_t key) const
+{
+    const uint64_t* end = keys_ + header_->nbStates;
+    const uint64_t* it = std::lower_bound(keys_, end, key);
+    if (it == end || *it != key)
+    {
+        return {0, 0, UNKNOWN_STATE, RANDOM_PIECE};
+    }
+    return answers_[it - keys_];
+}
+
+PolicyServer::PolicyServer(const PolicyTable& table,
+                           const std::string& socketPath)
+    : table_(table), path_(socketPath)
+{
+    sockaddr_un address = socketAddress(path_, "PolicyServer");
+    // only a socket left by a previous server is replaced
+    struct stat st;
+    if (lstat(path_.c_str(), &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            std::cerr << "ERROR (PolicyServer): " << path_
+                      << " exists and is not a socket" << std::endl;
+            exit(1);
+        }
+        unlink(path_.c_str());
+    }
+    else if (errno != ENOENT)
+    {
+        std::cerr << "ERROR (PolicyServer): cannot stat " << path_ << ": "
+                  << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+    listen_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listen_ < 0 ||
+        bind(listen_, reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) != 0 ||
+        listen(listen_, LISTEN_BACKLOG) != 0 ||
+        pipe2(wake_, O_NONBLOCK) != 0)
+    {
+        std::cerr << "ERROR (PolicyServer): cannot listen on " << path_ << ": "
+                  << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+}
+
+PolicyServer::~PolicyServer()
+{
+    for (const Client& client : clients_)
+    {
+        close(client.fd);
+    }
+    close(listen_);
+    close(wake_[0]);
+    close(wake_[1]);
+    unlink(path_.c_str());
+}
+
+void PolicyServer::stop()
+{
+    char byte = 0;
+    [[maybe_unused]] ssize_t n = write(wake_[1], &byte, 1);
+}
+
+bool PolicyServer::answer(Client& client)
+{
+    size_t done = 0;
+    while (client.in.size() - done >= sizeof(uint32_t) &&
+           client.out.size() < MAX_PENDING_OUTPUT)
+    {
+        uint32_t count;
+        std::memcpy(&count, &client.in[done], sizeof(count));
+        if (count > MAX_QUERY_BATCH)
+        {
+            return false;
+        }
+        size_t bytes = sizeof(uint32_t) + count * sizeof(uint64_t);
+        if (client.in.size() - done < bytes)
+        {
+            break;
+        }
+
+        if (count == 0)
+        {
+            int32_t info[4] = {table_.getWidth(), table_.getHeight(),
+                               table_.getNbPieces(), (int32_t)table_.size()};
+            const char* raw = reinterpret_cast<const char*>(info);
+            client.out.insert(client.out.end(), raw, raw + sizeof(info));
+        }
+        const char* keys = &client.in[done + sizeof(uint32_t)];
+        for (uint32_t q = 0; q < count; q++)
+        {
+            uint64_t key;
+            std::memcpy(&key, keys + q * sizeof(uint64_t), sizeof(key));
+            PolicyAnswer a = table_.query(key);
+            const char* raw = reinterpret_cast<const char*>(&a);
+            client.out.insert(client.out.end(), raw, raw + sizeof(a));
+        }
+        done += bytes;
+    }
+    client.in.erase(client.in.begin(), client.in.begin() + done);
+    return true;
+}
+
+void PolicyServer::run()
+{
+    std::vector<pollfd> fds;
+    char buffer[READ_CHUNK];
+    while (true)
+    {
+        fds.assign({{wake_[0], POLLIN, 0}, {listen_, POLLIN, 0}});
+        for (const Client& client : clients_)
+        {
+            // a client that does not read its answers is not read either
+            bool full = client.out.size() >= MAX_PENDING_OUTPUT ||
+                        client.in.size() >= MAX_PENDING_INPUT;
+            short events =
+                (full ? 0 : POLLIN) | (client.out.empty() ? 0 : POLLOUT);
+            fds.push_back({client.fd, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "ERROR (PolicyServer): poll: " << std::strerror(errno)
+                      << std::endl;
+            exit(1);
+        }
+        if (fds[0].revents)
+        {
+            return;
+        }
+
+        // fds[c + 2] is clients_[c], new clients are polled next time
+        std::vector<bool> closed(clients_.size(), false);
+        for (size_t c = 0; c < clients_.size(); c++)
+        {
+            Client& client = clients_[c];
+            if (fds[c + 2].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                ssize_t n = 1;
+                while (n > 0 && client.in.size() < MAX_PENDING_INPUT)
+                {
+                    n = read(client.fd, buffer, sizeof(buffer));
+                    if (n > 0)
+                    {
+                        client.in.insert(client.in.end(), buffer, buffer + n);
+                    }
+                }
+                closed[c] = n == 0 ||
+                            (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+            }
+            // a request over MAX_QUERY_BATCH keys drops the client
+            closed[c] = closed[c] || !answer(client);
+            if (!closed[c] && !client.out.empty())
+            {
+                ssize_t n = send(client.fd, client.out.data(),
+                                 client.out.size(), MSG_NOSIGNAL);
+                if (n > 0)
+                {
+                    client.out.erase(client.out.begin(),
+                                     client.out.begin() + n);
+                }
+                else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    closed[c] = true;
+                }
+            }
+            // requests held back by MAX_PENDING_OUTPUT, now that some left
+            closed[c] = closed[c] || !answer(client);
+        }
+        size_t kept = 0;
+        for (size_t c = 0; c < clients_.size(); c++)
+        {
+            if (closed[c])
+            {
+                close(clients_[c].fd);
+            }
+            else
+            {
+                // moving a client onto itself would empty its buffers
+                if (kept != c)
+                {
+                    clients_[kept] = std::move(clients_[c]);
+                }
+                kept++;
+            }
+        }
+        clients_.resize(kept);
+
+        if (fds[1].revents & POLLIN)
+        {
+            int fd;
+            while ((fd = accept4(listen_, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+            {
+                clients_.push_back({fd, {}, {}});
+            }
+        }
+    }
+}
+
+PolicyClient::PolicyClient(const std::string& socketPath)
+{
+    sockaddr_un address = socketAddress(socketPath, "PolicyClient");
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || connect(fd_, reinterpret_cast<sockaddr*>(&address),
+                           sizeof(address)) != 0)
+    {
+        std::cerr << "ERROR (PolicyClient): cannot connect to " << socketPath
+                  << ": " << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+}
+
+PolicyClient::~PolicyClient() { close(fd_); }
+
+void PolicyClient::send(const void* data, size_t bytes)
+{
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0)
+    {
+        ssize_t n = ::send(fd_, p, bytes, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            std::cerr << "ERROR (PolicyClient): the server went away"
+                      << std::endl;
+            exit(1);
+        }
+        p += n;
+        bytes -= n;
+    }
+}
+
+void PolicyClient::receive(void* data, size_t bytes)
+{
+    char* p = static_cast<char*>(data);
+    while (bytes > 0)
+    {
+        ssize_t n = read(fd_, p, bytes);
+        if (n <= 0)
+        {
+            std::cerr << "ERROR (PolicyClient): the server went away"
+                      << std::endl;
+            exit(1);
+        }
+        p += n;
+        bytes -= n;
+    }
+}
+
+std::vector<PolicyAnswer> PolicyClient::query(const std::vector<uint64_t>& keys)
+{
+    std::vector<PolicyAnswer> answers;
+    // larger requests are split in batches the server accepts
+    for (size_t begin = 0; begin < keys.size(); begin += MAX_QUERY_BATCH)
+    {
+        uint32_t count = std::min<size_t>(MAX_QUERY_BATCH, keys.size() - begin);
+        std::vector<char> request(sizeof(count) + count * sizeof(uint64_t));
+        std::memcpy(request.data(), &count, sizeof(count));
+        std::memcpy(request.data() + sizeof(count), &keys[begin],
+                    count * sizeof(uint64_t));
+        send(request.data(), request.size());
+
+        answers.resize(begin + count);
+        receive(&answers[begin], count * sizeof(PolicyAnswer));
+    }
+    return answers;
+}
+
+std::vector<int32_t> PolicyClient::info()
+{
+    uint32_t count = 0;
+    send(&count, sizeof(count));
+    std::vector<int32_t> info(4);
+    receive(info.data(), info.size() * sizeof(int32_t));
+    return info;
+}
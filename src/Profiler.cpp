@@ -0,0 +1,136 @@
+#include "Profiler.h"
+
+#ifdef PROFILE
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+const char* const POINT_NAMES[PROF_NB_POINTS] = {
+    "getAvailableActions", "genAllStatesFromAction", "completeLines",
+    "State::clone",        "State::hash",            "map lookup",
+    "graph build",         "graph expand slice",     "value sweep",
+    "policy evaluation"};
+
+struct Counters
+{
+    uint64_t calls[PROF_NB_POINTS] = {};
+    uint64_t cycles[PROF_NB_POINTS] = {};
+    uint64_t allocations[PROF_NB_POINTS] = {};
+};
+
+// totals of the threads that exited, printed when the program ends
+struct Report
+{
+    std::mutex mutex;
+    Counters total;
+    int threads[PROF_NB_POINTS] = {};
+    int nbThreads = 0;
+
+    void merge(const Counters& c)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        nbThreads++;
+        for (int p = 0; p < PROF_NB_POINTS; p++)
+        {
+            total.calls[p] += c.calls[p];
+            total.cycles[p] += c.cycles[p];
+            total.allocations[p] += c.allocations[p];
+            threads[p] += c.calls[p] > 0;
+        }
+    }
+
+    ~Report()
+    {
+        fprintf(stderr, "\n==== profile (%d threads) ====\n", nbThreads);
+        fprintf(stderr, "%-24s %8s %14s %16s %12s %14s\n", "point", "threads",
+                "calls", "cycles", "cycles/call", "allocations");
+        for (int p = 0; p < PROF_NB_POINTS; p++)
+        {
+            if (total.calls[p] == 0)
+            {
+                continue;
+            }
+            fprintf(stderr, "%-24s %8d %14llu %16llu %12.1f %14llu\n",
+                    POINT_NAMES[p], threads[p],
+                    (unsigned long long)total.calls[p],
+                    (unsigned long long)total.cycles[p],
+                    (double)total.cycles[p] / total.calls[p],
+                    (unsigned long long)total.allocations[p]);
+        }
+    }
+};
+
+Report& report()
+{
+    static Report r;
+    return r;
+}
+
+// one per thread, merged into the report when the thread exits
+struct ThreadCounters
+{
+    Counters counters;
+
+    // builds the report first so that it outlives the main thread's table
+    ThreadCounters() { report(); };
+    ~ThreadCounters() { report().merge(counters); };
+};
+
+thread_local ThreadCounters t_counters;
+thread_local uint64_t t_allocations = 0;
+} // namespace
+
+namespace profiler
+{
+uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+uint64_t allocations() { return t_allocations; }
+
+void record(ProfilePoint point, uint64_t cycles, uint64_t allocations)
+{
+    t_counters.counters.calls[point]++;
+    t_counters.counters.cycles[point] += cycles;
+    t_counters.counters.allocations[point] += allocations;
+}
+
+void count(ProfilePoint point) { t_counters.counters.calls[point]++; }
+
+uint64_t calls(ProfilePoint point) { return t_counters.counters.calls[point]; }
+} // namespace profiler
+
+// every allocation of the thread is counted, a scope reports the ones made
+// while it was open (nested scopes included)
+void* operator new(std::size_t size)
+{
+    t_allocations++;
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+#endif
@@ -1,16 +1,16 @@
 #include "State.h"
+#include "Profiler.h"
 
 std::vector<Point> State::placementPositions() const
 {
     std::vector<Point> positions;
-    const auto& grid = field_.getGrid();
     int cols = field_.getWidth();
     int rows = field_.getHeight();
     for (int c = 0; c < cols; ++c)
     {
         for (int l = 0; l < rows; ++l)
         {
-            if (grid[l][c])
+            if (field_.isFilled(l, c))
             {
                 if (l - 1 >= 0)
                     positions.emplace_back(l - 1, c);
@@ -25,6 +25,7 @@ std::vector<Point> State::placementPositions() const
 
 std::vector<Action> State::getAvailableActions() const
 {
+    PROFILE_SCOPE(PROF_AVAILABLE_ACTIONS);
     std::vector<Action> possibleActions;
     std::vector<Point> placementPos = placementPositions();
     std::vector<Point> emptyPositions = field_.getEmptyPositions();
@@ -38,7 +39,7 @@ std::vector<Action> State::getAvailableActions() const
             if (!field_.isAvailable(*nextTromino_, p.getX(), p.getY(), r))
                 continue;
 
-            std::vector<Offset> offsets = nextTromino_->getOffsets(r);
+            const std::vector<Offset>& offsets = nextTromino_->getOffsets(r);
             bool allBlocksAccessible = true;
             bool isInPlacementPos = false;
 
@@ -58,7 +59,7 @@ std::vector<Action> State::getAvailableActions() const
                 bool columnClear = true;
                 for (int l = 0; l < candidate.getX(); ++l)
                 {
-                    if (field_.getGrid()[l][candidate.getY()])
+                    if (field_.isFilled(l, candidate.getY()))
                     {
                         columnClear = false;
                         break;
@@ -84,11 +85,8 @@ State State::applyAction(Action& action)
     newField.addTromino(*nextTromino_, action.getPosition().getX(),
                         action.getPosition().getY(), action.getRotation());
 
-    std::unique_ptr<Tromino> newNext;
-    if ((rand() / (double)RAND_MAX) < PROBA_I_PIECE)
-        newNext = std::make_unique<IPiece>();
-    else
-        newNext = std::make_unique<LPiece>();
+    std::unique_ptr<Tromino> newNext =
+        std::make_unique<Tromino>(PieceSet::get().draw());
     return State(std::move(newField), std::move(newNext));
 }
 
@@ -99,11 +97,8 @@ State State::applyAction(const Action& action) const
     newField.addTromino(*nextTromino_, action.getPosition().getX(),
                         action.getPosition().getY(), action.getRotation());
 
-    std::unique_ptr<Tromino> newNext;
-    if ((rand() / (double)RAND_MAX) < PROBA_I_PIECE)
-        newNext = std::make_unique<IPiece>();
-    else
-        newNext = std::make_unique<LPiece>();
+    std::unique_ptr<Tromino> newNext =
+        std::make_unique<Tromino>(PieceSet::get().draw());
     return State(std::move(newField), std::move(newNext));
 }
 
@@ -119,69 +114,32 @@ State State::applyActionTromino(Action action, const Tromino& t)
 
 std::vector<State> State::genAllStatesFromAction(Action& action)
 {
-    Field newField1 = field_.clone();
-    newField1.addTromino(*nextTromino_, action.getPosition().getX(),
-                         action.getPosition().getY(), action.getRotation());
-
-    Field newField2 = field_.clone();
-    newField2.addTromino(*nextTromino_, action.getPosition().getX(),
-                         action.getPosition().getY(), action.getRotation());
-
-    std::unique_ptr<Tromino> next1 = std::make_unique<IPiece>();
-    std::unique_ptr<Tromino> next2 = std::make_unique<LPiece>();
-
-    std::vector<State> res;
-    res.reserve(2);
-    res.emplace_back(std::move(newField1), std::move(next1));
-    res.emplace_back(std::move(newField2), std::move(next2));
-    return res;
+    return static_cast<const State&>(*this).genAllStatesFromAction(
+        static_cast<const Action&>(action));
 }
 
-
 std::vector<State> State::genAllStatesFromAction(const Action& action) const
 {
-    Field newField1 = field_.clone();
-    newField1.addTromino(*nextTromino_, action.getPosition().getX(),
-                         action.getPosition().getY(), action.getRotation());
-
-    Field newField2 = field_.clone();
-    newField2.addTromino(*nextTromino_, action.getPosition().getX(),
-                         action.getPosition().getY(), action.getRotation());
-
-    std::unique_ptr<Tromino> next1 = std::make_unique<IPiece>();
-    std::unique_ptr<Tromino> next2 = std::make_unique<LPiece>();
+    PROFILE_SCOPE(PROF_GEN_ALL_STATES);
+    Field placedField = field_.clone();
+    placedField.addTromino(*nextTromino_, action.getPosition().getX(),
+                           action.getPosition().getY(), action.getRotation());
 
+    // one successor per piece of the set, the placement is shared
+    int nbPieces = PieceSet::get().size();
     std::vector<State> res;
-    res.reserve(2);
-    res.emplace_back(std::move(newField1), std::move(next1));
-    res.emplace_back(std::move(newField2), std::move(next2));
-    return res;
-}
-
-int State::nbCompleteLines() const
-{
-    int completedLines = 0;
-    const auto& grid = field_.getGrid();
-    int rows = field_.getHeight();
-    int cols = field_.getWidth();
-
-    for (int r = 0; r < rows; ++r)
+    res.reserve(nbPieces);
+    for (int p = 0; p < nbPieces - 1; p++)
     {
-        bool isComplete = true;
-        for (int c = 0; c < cols; ++c)
-        {
-            if (!grid[r][c])
-            {
-                isComplete = false;
-                break;
-            }
-        }
-        if (isComplete)
-            completedLines++;
+        res.emplace_back(placedField.clone(), std::make_unique<Tromino>(p));
     }
-    return completedLines;
+    res.emplace_back(std::move(placedField),
+                     std::make_unique<Tromino>(nbPieces - 1));
+    return res;
 }
 
+int State::nbCompleteLines() const { return field_.nbFullLines(); }
+
 int State::evaluate() const
 {
     int completedLines = nbCompleteLines();
@@ -198,6 +156,9 @@ int State::evaluate() const
     case 3:
         score += SCORE_3_LINES;
         break;
+    case 4:
+        score += SCORE_4_LINES;
+        break;
     default:
         break;
     }
@@ -207,85 +168,39 @@ int State::evaluate() const
 
 int State::gapCheck() const
 {
-    const auto& grid = field_.getGrid();
-    int rows = field_.getHeight();
-    int cols = field_.getWidth();
+    // a hole is an empty cell under a filled one of the same column: roof
+    // holds the columns filled somewhere above the current line
+    uint64_t roof = 0;
     int holes = 0;
-
-    for (int c = 0; c < cols; ++c)
+    for (int l = 0; l < field_.getHeight(); ++l)
     {
-        bool roof = false;
-        for (int r = 0; r < rows; ++r)
-        {
-            if (grid[r][c])
-            {
-                roof = true;
-            }
-            else if (roof)
-            {
-                holes++;
-            }
-        }
+        uint64_t row = field_.getRow(l);
+        holes += __builtin_popcountll(roof & ~row);
+        roof |= row;
     }
-    return holes; 
+    return holes;
 }
 
-
 State State::completeLines() const
 {
-    auto grid = field_.getGrid();
-    bool didComplete = false;
-
-    for (int r = 0; r < field_.getHeight(); ++r)
-    {
-        bool isComplete = true;
-        for (int c = 0; c < field_.getWidth(); ++c)
-        {
-            if (!field_.getGrid()[r][c])
-            {
-                isComplete = false;
-                break;
-            }
-        }
-        if (isComplete)
-        {
-            didComplete = true;
-            // clear complete line
-            grid[r] = {false, false, false, false};
-            // make all upper lines moving down
-            for (int row = r; row > 0; --row)
-            {
-                grid[row] = grid[row - 1];
-            }
-            // clear top line
-            for (int c = 0; c < field_.getWidth(); ++c)
-            {
-                grid[0][c] = false;
-            }
-        }
-    }
+    int nbLines;
+    return completeLines(nbLines);
+}
 
+State State::completeLines(int& nbLines) const
+{
+    PROFILE_SCOPE(PROF_COMPLETE_LINES);
     State newState = clone();
-
-    // the state after all line removals
-    if (didComplete)
-    {
-        newState.getField().setGrid(grid);
-    }
-
+    nbLines = newState.field_.clearLines();
     return newState;
 }
 
 State State::clone() const
 {
+    PROFILE_SCOPE(PROF_STATE_CLONE);
     std::unique_ptr<Tromino> newTromino;
     if (nextTromino_)
-    {
-        if (nextTromino_->isIPiece())
-            newTromino = std::make_unique<IPiece>();
-        else if (nextTromino_->isLPiece())
-            newTromino = std::make_unique<LPiece>();
-    }
+        newTromino = nextTromino_->clone();
 
     return State(field_.clone(), std::move(newTromino));
 }
@@ -299,7 +214,7 @@ std::ostream& operator<<(std::ostream& os, const State& s)
 
 bool State::operator==(const State& other) const
 {
-    if (field_.getGrid() != other.field_.getGrid())
+    if (!(field_ == other.field_))
     {
         return false;
     }
@@ -311,66 +226,62 @@ bool State::operator==(const State& other) const
     if (!thisHasPiece)
         return true;
 
-    bool thisIsIPiece = nextTromino_->isIPiece();
-    bool otherIsIPiece = other.nextTromino_->isIPiece();
-
-    return thisIsIPiece == otherIsIPiece;
+    return nextTromino_->getType() == other.nextTromino_->getType();
 }
 
-size_t State::hash() const
+uint64_t State::key() const
 {
     int width = field_.getWidth();
     int height = field_.getHeight();
     int cells = width * height;
+    uint64_t nbCodes = PieceSet::get().size() + 1;
 
-    if (cells < 0 || cells >= 64)
+    // the board bits times the number of piece codes must fit in 64 bits
+    if (cells < 0 || cells >= 64 || (~0ULL >> cells) < nbCodes)
     {
-        return static_cast<size_t>(-1);
+        return static_cast<uint64_t>(-1);
     }
 
     uint64_t mask = 0ULL;
-    const auto& grid = field_.getGrid();
-
-    if ((int)grid.size() != height)
-    {
-        return static_cast<size_t>(-1);
-    }
-
     for (int r = 0; r < height; ++r)
     {
-        if ((int)grid[r].size() != width)
-        {
-            return static_cast<size_t>(-1);
-        }
-        for (int c = 0; c < width; ++c)
-        {
-            if (grid[r][c])
-            {
-                mask |= (1ULL << (r * width + c));
-            }
-        }
+        mask |= field_.getRow(r) << (r * width);
     }
 
-    size_t pieceIndex;
+    uint64_t pieceIndex;
     if (nextTromino_)
     {
-        if (nextTromino_->isIPiece())
-        {
-            pieceIndex = 1;
-        }
-        else if (nextTromino_->isLPiece())
-        {
-            pieceIndex = 2;
-        }
-        else
-        {
-            return static_cast<size_t>(-1); // Unknown piece
-        }
+        pieceIndex = nextTromino_->getType() + 1;
     }
     else
     {
         pieceIndex = 0; // No piece
     }
 
-    return static_cast<size_t>(mask) * 3 + pieceIndex;
+    return mask * nbCodes + pieceIndex;
+}
+
+State State::fromKey(uint64_t key, int width, int height)
+{
+    uint64_t nbCodes = PieceSet::get().size() + 1;
+    uint64_t mask = key / nbCodes;
+    Field field(width, height);
+    uint64_t rowMask = field.fullRow();
+    for (int r = 0; r < height; ++r)
+    {
+        field.setRow(r, (mask >> (r * width)) & rowMask);
+    }
+
+    std::unique_ptr<Tromino> t;
+    if (key % nbCodes != 0)
+    {
+        t = std::make_unique<Tromino>(key % nbCodes - 1);
+    }
+    return State(std::move(field), std::move(t));
+}
+
+size_t State::hash() const
+{
+    PROFILE_SCOPE(PROF_STATE_HASH);
+    return static_cast<size_t>(key());
 }
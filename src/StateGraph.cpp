@@ -0,0 +1,314 @@
+#include "StateGraph.h"
+#include "Profiler.h"
+#include "Workers.h"
+
+namespace
+{
+// Everything a worker learns from its slice of a BFS level. Successors are
+// kept as keys since their ids are only known once the level is merged.
+struct Expansion
+{
+    std::vector<int32_t> nbActions;
+    std::vector<Action> actions;
+    std::vector<uint64_t> nextKeys;
+    std::vector<Transition> transitions;
+    std::vector<uint64_t> discovered; // sorted and deduplicated nextKeys
+};
+
+void expandSlice(const std::vector<uint64_t>& frontier,
+                 size_t begin,
+                 size_t end,
+                 int width,
+                 int height,
+                 Expansion& out)
+{
+    PROFILE_SCOPE(PROF_GRAPH_EXPAND);
+    for (size_t i = begin; i < end; i++)
+    {
+        // only keys leave the iteration, its boards live in the arena
+        Arena::Scope scratch(Arena::local());
+        State currState = State::fromKey(frontier[i], width, height);
+        std::vector<Action> actions = currState.getAvailableActions();
+        out.nbActions.push_back(actions.size());
+
+        for (const Action& a : actions)
+        {
+            out.actions.push_back(a);
+            for (State& placedState : currState.genAllStatesFromAction(a))
+            {
+                int lines;
+                State afterState = placedState.completeLines(lines);
+                out.nextKeys.push_back(afterState.key());
+                out.transitions.push_back(
+                    {-1, (uint8_t)lines,
+                     (uint8_t)placedState.getField().getMaxHeight(),
+                     (uint8_t)placedState.evaluate(),
+                     (uint8_t)placedState.gapCheck()});
+            }
+        }
+    }
+
+    out.discovered = out.nextKeys;
+    std::sort(out.discovered.begin(), out.discovered.end());
+    out.discovered.erase(
+        std::unique(out.discovered.begin(), out.discovered.end()),
+        out.discovered.end());
+}
+} // namespace
+
+StateGraph::StateGraph(const State& s0, int nbThreads)
+    : width_(s0.getField().getWidth()), height_(s0.getField().getHeight()),
+      nbPieces_(PieceSet::get().size())
+{
+    PROFILE_SCOPE(PROF_GRAPH_BUILD);
+    // states are identified by their key, which only exists for small boards
+    if (s0.key() == static_cast<uint64_t>(-1))
+    {
+        std::cerr << "ERROR (StateGraph): a " << width_ << "x" << height_
+                  << " board with " << nbPieces_
+                  << " pieces does not fit in a 64-bit state key" << std::endl;
+        exit(1);
+    }
+    nbThreads = std::max(1, nbThreads);
+    std::vector<uint64_t> frontier;
+    std::vector<uint64_t> nextKeys;
+
+    // the first piece is drawn at random, so every variant of s0 is a root
+    roots_ = {s0.key()};
+    for (int p = 0; p < nbPieces_; p++)
+    {
+        State root = s0.clone();
+        root.setNextTromino(Tromino(p));
+        roots_.push_back(root.key());
+    }
+    for (uint64_t key : roots_)
+    {
+        if (ids_.emplace(key, keys_.size()).second)
+        {
+            keys_.push_back(key);
+            frontier.push_back(key);
+        }
+    }
+
+    actionOffsets_.push_back(0);
+    while (!frontier.empty())
+    {
+        int nbWorkers = workersFor(frontier.size(), nbThreads);
+        std::vector<Expansion> parts(nbWorkers);
+
+        runWorkers(nbWorkers,
+                   [&](int w)
+                   {
+                       size_t begin = frontier.size() * w / nbWorkers;
+                       size_t end = frontier.size() * (w + 1) / nbWorkers;
+                       expandSlice(frontier, begin, end, width_, height_,
+                                   parts[w]);
+                   });
+
+        // slices are contiguous, so appending them keeps the id order
+        std::vector<uint64_t> discovered;
+        for (Expansion& part : parts)
+        {
+            for (int32_t n : part.nbActions)
+            {
+                actionOffsets_.push_back(actionOffsets_.back() + n);
+            }
+            actions_.insert(actions_.end(), part.actions.begin(),
+                            part.actions.end());
+            transitions_.insert(transitions_.end(), part.transitions.begin(),
+                                part.transitions.end());
+            nextKeys.insert(nextKeys.end(), part.nextKeys.begin(),
+                            part.nextKeys.end());
+
+            size_t middle = discovered.size();
+            discovered.insert(discovered.end(), part.discovered.begin(),
+                              part.discovered.end());
+            std::inplace_merge(discovered.begin(),
+                               discovered.begin() + middle, discovered.end());
+        }
+        discovered.erase(std::unique(discovered.begin(), discovered.end()),
+                         discovered.end());
+
+        frontier.clear();
+        for (uint64_t key : discovered)
+        {
+            if (ids_.emplace(key, keys_.size()).second)
+            {
+                keys_.push_back(key);
+                frontier.push_back(key);
+            }
+        }
+    }
+
+    // every successor has an id now, resolve them (ids_ is read-only here)
+    int nbWorkers = workersFor(transitions_.size(), nbThreads);
+    runWorkers(nbWorkers,
+               [&](int w)
+               {
+                   size_t begin = transitions_.size() * w / nbWorkers;
+                   size_t end = transitions_.size() * (w + 1) / nbWorkers;
+                   for (size_t t = begin; t < end; t++)
+                   {
+                       transitions_[t].next = ids_.find(nextKeys[t])->second;
+                   }
+               });
+}
+
+State StateGraph::getState(int id) const
+{
+    return State::fromKey(keys_[id], width_, height_);
+}
+
+int StateGraph::find(uint64_t key) const
+{
+    auto it = ids_.find(key);
+    if (it == ids_.end())
+    {
+        return -1;
+    }
+    return it->second;
+}
+
+std::vector<int32_t> StateGraph::ordering(StateOrder order) const
+{
+    int n = size();
+    // breadth-first from the roots, successors in action then piece order
+    std::vector<int32_t> result;
+    std::vector<bool> visited(n, false);
+    result.reserve(n);
+    for (uint64_t key : roots_)
+    {
+        int root = find(key);
+        if (!visited[root])
+        {
+            visited[root] = true;
+            result.push_back(root);
+        }
+    }
+    for (size_t head = 0; head < result.size(); head++)
+    {
+        int s = result[head];
+        for (size_t t = (size_t)actionBegin(s) * nbPieces_;
+             t < (size_t)actionEnd(s) * nbPieces_; t++)
+        {
+            int next = transitions_[t].next;
+            if (!visited[next])
+            {
+                visited[next] = true;
+                result.push_back(next);
+            }
+        }
+    }
+
+    if (order == ORDER_HEIGHT)
+    {
+        std::vector<int> heights(n);
+        for (int s = 0; s < n; s++)
+        {
+            heights[s] = getState(s).getField().getMaxHeight();
+        }
+        std::stable_sort(result.begin(), result.end(), [&](int a, int b)
+                         { return heights[a] < heights[b]; });
+    }
+    else if (order == ORDER_RCM)
+    {
+        // undirected adjacency: successors and predecessors
+        std::vector<std::vector<int32_t>> neighbours(n);
+        for (int s = 0; s < n; s++)
+        {
+            for (size_t t = (size_t)actionBegin(s) * nbPieces_;
+                 t < (size_t)actionEnd(s) * nbPieces_; t++)
+            {
+                int next = transitions_[t].next;
+                if (next != s)
+                {
+                    neighbours[s].push_back(next);
+                    neighbours[next].push_back(s);
+                }
+            }
+        }
+        for (std::vector<int32_t>& adjacent : neighbours)
+        {
+            std::sort(adjacent.begin(), adjacent.end());
+            adjacent.erase(std::unique(adjacent.begin(), adjacent.end()),
+                           adjacent.end());
+        }
+        auto byDegree = [&](int a, int b)
+        { return neighbours[a].size() < neighbours[b].size(); };
+
+        // Cuthill-McKee from a lowest degree state of every component,
+        // neighbours visited by increasing degree, then reversed
+        std::vector<int32_t> byLowDegree(result);
+        std::stable_sort(byLowDegree.begin(), byLowDegree.end(), byDegree);
+        visited.assign(n, false);
+        result.clear();
+        for (int start : byLowDegree)
+        {
+            if (visited[start])
+            {
+                continue;
+            }
+            visited[start] = true;
+            size_t head = result.size();
+            result.push_back(start);
+            while (head < result.size())
+            {
+                int s = result[head++];
+                size_t first = result.size();
+                for (int next : neighbours[s])
+                {
+                    if (!visited[next])
+                    {
+                        visited[next] = true;
+                        result.push_back(next);
+                    }
+                }
+                std::stable_sort(result.begin() + first, result.end(),
+                                 byDegree);
+            }
+        }
+        std::reverse(result.begin(), result.end());
+    }
+    return result;
+}
+
+void StateGraph::renumber(const std::vector<int32_t>& order)
+{
+    int n = size();
+    std::vector<int32_t> newId(n);
+    for (int i = 0; i < n; i++)
+    {
+        newId[order[i]] = i;
+    }
+
+    std::vector<uint64_t> keys(n);
+    std::vector<int32_t> actionOffsets = {0};
+    std::vector<Action> actions;
+    std::vector<Transition> transitions;
+    actionOffsets.reserve(n + 1);
+    actions.reserve(actions_.size());
+    transitions.reserve(transitions_.size());
+
+    for (int i = 0; i < n; i++)
+    {
+        int s = order[i];
+        keys[i] = keys_[s];
+        ids_[keys_[s]] = i;
+        for (int k = actionBegin(s); k < actionEnd(s); k++)
+        {
+            actions.push_back(actions_[k]);
+            for (int p = 0; p < nbPieces_; p++)
+            {
+                Transition t = getTransition(k, p);
+                t.next = newId[t.next];
+                transitions.push_back(t);
+            }
+        }
+        actionOffsets.push_back(actions.size());
+    }
+
+    keys_ = std::move(keys);
+    actionOffsets_ = std::move(actionOffsets);
+    actions_ = std::move(actions);
+    transitions_ = std::move(transitions);
+}
@@ -1,9 +1,13 @@
 #include "Action.h"
+#include "GraphExport.h"
 #include "MDP.h"
+#include "PolicyServer.h"
 #include "State.h"
+#include "Trace.h"
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <csignal>
 #include <cstdlib>
 #include <fstream>
 #include <functional>
@@ -21,8 +25,9 @@
 #define EPSILON 0.00000001
 #define MAX_IT 1000
 #define ACTION_POLICY_LAMBDA 0.9
+#define ANDERSON_MEMORY 5
 #define TROMINO_POLICY_LAMBDA 0.1
-#define NB_SIMU 100
+#define FINITE_HORIZON_TAIL 10
 
 // --- Global Data Structures ---
 
@@ -36,6 +41,9 @@ struct RunResult
     double minavg_score;
     double gapavg_score;
     double min_score;
+    std::array<int, 3> random_quantiles; // 1%, median and 99% vs random
+    double random_truncated; // probability dropped before the quantiles
+    CompactPolicy policy;
 };
 
 // Global adversary policies to be accessible by all threads (read-only)
@@ -44,9 +52,21 @@ std::unordered_map<State, std::unique_ptr<Tromino>> g_minmax_tromino;
 std::unordered_map<State, std::unique_ptr<Tromino>> g_minavg_tromino;
 std::unordered_map<State, std::unique_ptr<Tromino>> g_gapavg_tromino;
 
+// Same policies as pieces indexed by the ids of the shared state graph
+std::shared_ptr<const StateGraph> g_graph;
+std::vector<int8_t> g_rand_pieces;
+std::vector<int8_t> g_minmax_pieces;
+std::vector<int8_t> g_minavg_pieces;
+std::vector<int8_t> g_gapavg_pieces;
+
 // Global mutex to protect console output
 std::mutex g_cout_mutex;
 
+// Daemon of `tetris serve`, stopped by SIGINT and SIGTERM
+PolicyServer* g_server = nullptr;
+
+void stopServer(int) { g_server->stop(); }
+
 // --- Thread-safe evaluation function ---
 
 RunResult evaluate_configuration(int idx, std::array<double, 4> p, State s0)
@@ -56,10 +76,9 @@ RunResult evaluate_configuration(int idx, std::array<double, 4> p, State s0)
     double score_w = p[2];
     double gap_r = p[3];
 
-    // Each thread gets its own MDP and Game objects
-    Field field(WIDTH, HEIGHT);
-    Game game(field);
+    // Each thread gets its own MDP, all of them share the state graph
     MDP mdp(WIDTH, HEIGHT, s0.clone());
+    mdp.setGraph(g_graph);
 
     {
         std::lock_guard<std::mutex> lock(g_cout_mutex);
@@ -69,27 +88,35 @@ RunResult evaluate_configuration(int idx, std::array<double, 4> p, State s0)
     }
 
     std::unordered_map<State, Action> policy =
-        mdp.actionValueIteration(ACTION_POLICY_LAMBDA, line_w, height_w,
-                                 score_w, gap_r, EPSILON, MAX_IT);
+        mdp.acceleratedActionValueIteration(ACTION_POLICY_LAMBDA, line_w,
+                                            height_w, score_w, gap_r, EPSILON,
+                                            MAX_IT, ANDERSON_MEMORY);
 
-    double rand_score_sum = 0;
-    for (int i = 0; i < NB_SIMU; ++i)
-    {
-        rand_score_sum += mdp.playPolicy(game, policy, g_rand_tromino);
-    }
-    double rand_avg = rand_score_sum / NB_SIMU;
+    CompiledPolicy compiled = mdp.compilePolicy(policy);
+    CompactPolicy compact = mdp.compactPolicy(policy);
+
+    double rand_avg = compiled.expectedScore(g_rand_pieces, MAX_ACTION);
     double minmax_score =
-        (double)mdp.playPolicy(game, policy, g_minmax_tromino);
+        compiled.expectedScore(g_minmax_pieces, MAX_ACTION);
     double minavg_score =
-        (double)mdp.playPolicy(game, policy, g_minavg_tromino);
+        compiled.expectedScore(g_minavg_pieces, MAX_ACTION);
     double gapavg_score =
-        (double)mdp.playPolicy(game, policy, g_gapavg_tromino);
+        compiled.expectedScore(g_gapavg_pieces, MAX_ACTION);
 
     double min_score =
         std::min({rand_avg, minmax_score, minavg_score, gapavg_score});
 
-    return {idx,          p,        rand_avg, minmax_score, minavg_score,
-            gapavg_score, min_score};
+    // the deterministic adversaries give a single game, only the random
+    // one has a spread worth reporting
+    GameDistribution rand_dist = compiled.distribution(
+        g_rand_pieces, MAX_ACTION, std::thread::hardware_concurrency());
+    std::array<int, 3> rand_quantiles = {rand_dist.scoreQuantile(0.01),
+                                         rand_dist.scoreQuantile(0.5),
+                                         rand_dist.scoreQuantile(0.99)};
+
+    return {idx,          p,            rand_avg,  minmax_score,
+            minavg_score, gapavg_score, min_score, rand_quantiles,
+            rand_dist.truncated, std::move(compact)};
 }
 
 // --- Analysis Helper Functions ---
@@ -118,29 +145,105 @@ void print_result_summary(const std::string& title, const RunResult& result)
               << " | MinAvg: " << result.minavg_score
               << " | GapAvg: " << result.gapavg_score
               << " | Min Score: " << result.min_score << std::endl
+              << "  Random score quantiles -> 1%: "
+              << result.random_quantiles[0]
+              << " | median: " << result.random_quantiles[1]
+              << " | 99%: " << result.random_quantiles[2]
+              << std::scientific << std::setprecision(1)
+              << " (truncated mass " << result.random_truncated << ")"
+              << std::fixed << std::setprecision(2) << std::endl
               << std::endl;
 }
 
-int main()
+int main(int argc, char** argv)
 {
     srand((time(NULL) & 0xFFFF));
 
+    // `tetris replay FILE [GAME]` lists the games of a trace or shows one
+    if ((argc == 3 || argc == 4) && std::string(argv[1]) == "replay")
+    {
+        if (argc == 3)
+        {
+            replayTrace(argv[2]);
+        }
+        else
+        {
+            replayTrace(argv[2], std::stoul(argv[3]));
+        }
+        return 0;
+    }
+
+    // `tetris serve SOCKET TABLE` answers policy queries until stopped
+    if (argc == 4 && std::string(argv[1]) == "serve")
+    {
+        PolicyTable table(argv[3]);
+        PolicyServer server(table, argv[2]);
+        g_server = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+        std::cout << "Serving " << table.size() << " states on " << argv[2]
+                  << std::endl;
+        server.run();
+        return 0;
+    }
+
     Field master_field(WIDTH, HEIGHT);
     Game master_game(master_field);
     MDP master_mdp(WIDTH, HEIGHT, master_game.getState().clone());
     State s0 = master_game.getState().clone();
 
+    // `tetris export DIR` writes the model as .npy arrays and stops
+    if (argc == 3 && std::string(argv[1]) == "export")
+    {
+        exportGraph(master_mdp.getGraph(), argv[2]);
+        std::cout << "Exported " << master_mdp.getGraph().size()
+                  << " states and " << master_mdp.getGraph().nbActions()
+                  << " actions to " << argv[2] << std::endl;
+        return 0;
+    }
+    // `tetris table FILE` writes the MaxMin policy and its adversary for
+    // `tetris serve` and stops
+    if (argc == 3 && std::string(argv[1]) == "table")
+    {
+        GameSolution equilibrium = master_mdp.gameValueIteration(
+            EPSILON, MAX_IT, ACTION_POLICY_LAMBDA);
+        writePolicyTable(argv[2], master_mdp.getGraph(),
+                         master_mdp.compactPolicy(equilibrium.actions),
+                         master_mdp.compileAdversary(equilibrium.trominos));
+        std::cout << "Wrote the policy of " << master_mdp.getGraph().size()
+                  << " states to " << argv[2] << std::endl;
+        return 0;
+    }
+    // `tetris --trace FILE` records the games played with playPolicy
+    if (argc == 3 && std::string(argv[1]) == "--trace")
+    {
+        TraceRecorder::open(argv[2], WIDTH, HEIGHT);
+    }
+    else if (argc != 1)
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " [export DIR | --trace FILE | replay FILE [GAME] | "
+                     "table FILE | serve SOCKET TABLE]"
+                  << std::endl;
+        return 1;
+    }
+
     std::cout << "Computing adversary policies..." << std::endl;
     // Initialize global adversary policies
     g_rand_tromino =
         std::unordered_map<State,
                            std::unique_ptr<Tromino>>(); // Empty map for random
-    g_minmax_tromino = master_mdp.trominoValueIterationMinMax(
-        EPSILON, MAX_IT, TROMINO_POLICY_LAMBDA);
-    g_minavg_tromino = master_mdp.trominoValueIterationMinAvg(
-        EPSILON, MAX_IT, TROMINO_POLICY_LAMBDA);
-    g_gapavg_tromino = master_mdp.trominoValueIterationGapAvg(
-        EPSILON, MAX_IT, TROMINO_POLICY_LAMBDA);
+    AdversarySolution adversaries = master_mdp.adversaryValueIteration(
+        EPSILON, MAX_IT, TROMINO_POLICY_LAMBDA,
+        std::thread::hardware_concurrency());
+    g_minmax_tromino = std::move(adversaries.minMax);
+    g_minavg_tromino = std::move(adversaries.minAvg);
+    g_gapavg_tromino = std::move(adversaries.gapAvg);
+    g_graph = master_mdp.getSharedGraph();
+    g_rand_pieces = master_mdp.compileAdversary(g_rand_tromino);
+    g_minmax_pieces = master_mdp.compileAdversary(g_minmax_tromino);
+    g_minavg_pieces = master_mdp.compileAdversary(g_minavg_tromino);
+    g_gapavg_pieces = master_mdp.compileAdversary(g_gapavg_tromino);
     std::cout << "Adversary policies computed." << std::endl << std::endl;
 
     std::cout << "--- Starting Parallel Configuration Exploration ---"
@@ -295,17 +398,42 @@ int main()
                               });
         print_result_summary("Best Overall (Average across all Adversaries)",
                              best_overall);
+
+        std::cout << "--- States changing action vs configuration #0 ---"
+                  << std::endl;
+        for (const auto& result : all_results)
+        {
+            std::cout << "  #" << result.config_index << ": "
+                      << result.policy.diff(all_results[0].policy) << " / "
+                      << result.policy.size() << std::endl;
+        }
+        std::cout << std::endl;
     }
 
-    std::unordered_map<State, Action> robustPolicyMaxMin =
-        master_mdp.robustActionValueIterationMaxMin(EPSILON, MAX_IT,
-                                                    ACTION_POLICY_LAMBDA);
+    CompactAdversary minmax = master_mdp.compactAdversary(g_minmax_tromino);
+    CompactAdversary minavg = master_mdp.compactAdversary(g_minavg_tromino);
+    CompactAdversary gapavg = master_mdp.compactAdversary(g_gapavg_tromino);
+    std::cout << "States where the adversaries disagree: MinMax/MinAvg "
+              << minmax.diff(minavg) << ", MinMax/GapAvg "
+              << minmax.diff(gapavg) << ", MinAvg/GapAvg "
+              << minavg.diff(gapavg) << std::endl;
+
+    GameSolution equilibrium = master_mdp.gameValueIteration(
+        EPSILON, MAX_IT, ACTION_POLICY_LAMBDA);
+    std::unordered_map<State, Action>& robustPolicyMaxMin =
+        equilibrium.actions;
 
     std::cout << std::endl
               << std::endl
               << "In comparison, the MaxMin VI got these performances:"
               << std::endl;
 
+    std::cout << "Guaranteed discounted value: " << equilibrium.value
+              << std::endl;
+    std::cout << "vs its worst case adversary: "
+              << master_mdp.playPolicy(master_game, robustPolicyMaxMin,
+                                       equilibrium.trominos)
+              << std::endl;
     std::cout << "vs Random: "
               << master_mdp.playPolicy(master_game, robustPolicyMaxMin,
                                        g_rand_tromino)
@@ -323,5 +451,22 @@ int main()
                                        g_gapavg_tromino)
               << std::endl;
 
+    // the objective the scores above are measured with: total score over
+    // MAX_ACTION moves against random pieces
+    FiniteHorizonSolution finite = master_mdp.finiteHorizonIteration(
+        0, 0, 1, 0, MAX_ACTION, EPSILON, FINITE_HORIZON_TAIL);
+    std::cout << std::endl
+              << "Best expected score over " << MAX_ACTION
+              << " moves vs Random: " << finite.value;
+    if (finite.steps < MAX_ACTION)
+    {
+        std::cout << " +/- " << std::scientific << std::setprecision(1)
+                  << finite.error << std::fixed << std::setprecision(2)
+                  << " (stable after " << finite.steps
+                  << " backward steps, the rest extrapolated)";
+    }
+    std::cout << std::endl;
+
+    TraceRecorder::close();
     return 0;
 }
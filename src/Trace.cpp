@@ -0,0 +1,285 @@
+#include "Trace.h"
+#include "MDP.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define TRACE_MAGIC 0x43525454 // "TTRC"
+#define TRACE_VERSION 1
+// the flusher sleeps until a ring is half full, or this long so that
+// short games still reach the file
+#define TRACE_FLUSH_MS 100
+
+static_assert(sizeof(TraceRecord) == 16, "trace records are 16 bytes");
+
+namespace
+{
+// single producer (the owning thread), single consumer (the flusher)
+struct Ring
+{
+    TraceRecord records[TRACE_RING_SIZE];
+    std::atomic<uint64_t> head{0}; // next record to write
+    std::atomic<uint64_t> tail{0}; // next record to flush
+};
+
+struct Session
+{
+    std::ofstream out;
+    std::mutex ringsMutex; // only taken when a thread joins the session
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stop = false;   // guarded by wakeMutex
+    bool pending = false; // a ring is half full, guarded by wakeMutex
+    std::thread flusher;
+};
+
+std::atomic<bool> tracing{false};
+std::atomic<uint32_t> nextGame{0};
+std::atomic<uint32_t> sessionId{0};
+std::unique_ptr<Session> session;
+
+// writes what the producers have published since the last call
+void drain(Session& s)
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(s.ringsMutex);
+        rings = s.rings;
+    }
+    for (const std::shared_ptr<Ring>& ring : rings)
+    {
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while (tail < head)
+        {
+            size_t begin = tail % TRACE_RING_SIZE;
+            size_t count = std::min<uint64_t>(head - tail,
+                                              TRACE_RING_SIZE - begin);
+            s.out.write(reinterpret_cast<const char*>(&ring->records[begin]),
+                        count * sizeof(TraceRecord));
+            tail += count;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+// the ring is owned by the session, a thread only remembers which one it
+// joined, so the fast path is two plain thread-local reads
+thread_local Ring* t_ring = nullptr;
+thread_local uint32_t t_joined = 0;
+
+Ring& threadRing()
+{
+    uint32_t id = sessionId.load(std::memory_order_acquire);
+    if (!t_ring || t_joined != id)
+    {
+        std::shared_ptr<Ring> ring = std::make_shared<Ring>();
+        t_ring = ring.get();
+        t_joined = id;
+        std::lock_guard<std::mutex> lock(session->ringsMutex);
+        session->rings.push_back(std::move(ring));
+    }
+    return *t_ring;
+}
+
+void wakeFlusher()
+{
+    {
+        std::lock_guard<std::mutex> lock(session->wakeMutex);
+        session->pending = true;
+    }
+    session->wake.notify_one();
+}
+
+template <typename T> void writeValue(std::ofstream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> T readValue(std::ifstream& in)
+{
+    T value;
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
+
+} // namespace
+
+TraceFile readTrace(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "ERROR (readTrace): cannot read " << path << std::endl;
+        exit(1);
+    }
+    if (readValue<uint32_t>(in) != TRACE_MAGIC ||
+        readValue<uint32_t>(in) != TRACE_VERSION)
+    {
+        std::cerr << "ERROR (readTrace): " << path
+                  << " is not a trace of this version" << std::endl;
+        exit(1);
+    }
+    TraceFile trace;
+    trace.width = readValue<int32_t>(in);
+    trace.height = readValue<int32_t>(in);
+    TraceRecord record;
+    while (in.read(reinterpret_cast<char*>(&record), sizeof(record)))
+    {
+        trace.records.push_back(record);
+    }
+    return trace;
+}
+
+void TraceRecorder::open(const std::string& path, int width, int height)
+{
+    close();
+    session = std::make_unique<Session>();
+    session->out.open(path, std::ios::binary);
+    if (!session->out)
+    {
+        std::cerr << "ERROR (TraceRecorder): cannot write " << path
+                  << std::endl;
+        exit(1);
+    }
+    writeValue<uint32_t>(session->out, TRACE_MAGIC);
+    writeValue<uint32_t>(session->out, TRACE_VERSION);
+    writeValue<int32_t>(session->out, width);
+    writeValue<int32_t>(session->out, height);
+
+    Session* s = session.get();
+    s->flusher = std::thread(
+        [s]
+        {
+            std::unique_lock<std::mutex> lock(s->wakeMutex);
+            while (!s->stop)
+            {
+                s->wake.wait_for(lock,
+                                 std::chrono::milliseconds(TRACE_FLUSH_MS),
+                                 [s] { return s->stop || s->pending; });
+                s->pending = false;
+                lock.unlock();
+                drain(*s);
+                lock.lock();
+            }
+        });
+    sessionId.fetch_add(1, std::memory_order_release);
+    tracing.store(true, std::memory_order_release);
+}
+
+void TraceRecorder::close()
+{
+    if (!session)
+    {
+        return;
+    }
+    // the games still being recorded must be over by now
+    tracing.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(session->wakeMutex);
+        session->stop = true;
+    }
+    session->wake.notify_one();
+    session->flusher.join();
+    drain(*session);
+    if (!session->out)
+    {
+        std::cerr << "ERROR (TraceRecorder): failed writing the trace"
+                  << std::endl;
+        exit(1);
+    }
+    session.reset();
+}
+
+bool TraceRecorder::enabled()
+{
+    return tracing.load(std::memory_order_relaxed);
+}
+
+uint32_t TraceRecorder::beginGame()
+{
+    return nextGame.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TraceRecorder::record(uint32_t game,
+                           const State& before,
+                           const Action& action,
+                           int piece,
+                           int gain)
+{
+    Ring& ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    // full ring: wait for the flusher rather than lose moves
+    while (head - ring.tail.load(std::memory_order_acquire) >= TRACE_RING_SIZE)
+    {
+        wakeFlusher();
+        std::this_thread::yield();
+    }
+    ring.records[head % TRACE_RING_SIZE] = {
+        before.key(),
+        game,
+        (int8_t)action.getPosition().getX(),
+        (int8_t)action.getPosition().getY(),
+        (uint8_t)(action.getRotation() | piece << 4),
+        (uint8_t)gain};
+    ring.head.store(head + 1, std::memory_order_release);
+    if ((head + 1) % (TRACE_RING_SIZE / 2) == 0)
+    {
+        wakeFlusher();
+    }
+}
+
+void replayTrace(const std::string& path)
+{
+    TraceFile trace = readTrace(path);
+    // moves and score per game
+    std::map<uint32_t, std::pair<int, int>> games;
+    for (const TraceRecord& r : trace.records)
+    {
+        games[r.game].first++;
+        games[r.game].second += r.gain;
+    }
+    std::cout << games.size() << " games of " << trace.width << "x"
+              << trace.height << " in " << path << std::endl;
+    for (const auto& [game, summary] : games)
+    {
+        std::cout << "  game " << game << ": " << summary.first
+                  << " moves, score " << summary.second << std::endl;
+    }
+}
+
+void replayTrace(const std::string& path, uint32_t game)
+{
+    TraceFile trace = readTrace(path);
+    int score = 0, moves = 0;
+    for (const TraceRecord& r : trace.records)
+    {
+        if (r.game != game)
+        {
+            continue;
+        }
+        State curr = State::fromKey(r.key, trace.width, trace.height);
+        Action action(Point(r.line, r.column), r.rotationPiece & 0xF);
+        State placed =
+            curr.applyActionTromino(action, Tromino(r.rotationPiece >> 4));
+        State after = placed.completeLines();
+
+        score += r.gain;
+        std::cout << "Move " << ++moves << ", score " << score << std::endl;
+        MDP::prettyPrint(curr, placed.clone(), after.clone());
+        std::cout << std::endl;
+    }
+    if (moves == 0)
+    {
+        std::cerr << "ERROR (replayTrace): no game " << game << " in " << path
+                  << std::endl;
+        exit(1);
+    }
+}
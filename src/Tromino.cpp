@@ -1,45 +1,162 @@
 #include "Tromino.h"
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
 
-std::vector<Offset> IPiece::getOffsets(int rotation) const
+#define TROMINO_POOL_CHUNK 4096 // blocks per refill
+// a thread keeps at most this many free blocks, the rest goes to the pool
+#define TROMINO_LOCAL_BLOCKS (2 * TROMINO_POOL_CHUNK)
+
+namespace
+{
+union PoolBlock
+{
+    PoolBlock* next;
+    alignas(Tromino) char storage[sizeof(Tromino)];
+};
+
+struct Batch
+{
+    PoolBlock* head;
+    size_t size;
+};
+
+// Free blocks shared by all threads. Chunks are never returned to the
+// system, but a block freed anywhere can be reused by any thread.
+struct SharedPool
+{
+    std::mutex mutex;
+    std::vector<Batch> batches;
+};
+
+SharedPool& sharedPool()
 {
-    int r = ((rotation % 2) + 2) % 2;
-    if (r == 0)
+    // never destroyed, threads may give blocks back during exit
+    static SharedPool* pool = new SharedPool();
+    return *pool;
+}
+
+// Blocks are taken from and freed to the list of the calling thread. A list
+// that grows past TROMINO_LOCAL_BLOCKS (blocks allocated on one thread and
+// freed on another) and the list of an exiting thread go to the shared pool.
+struct FreeList
+{
+    PoolBlock* head = nullptr;
+    size_t size = 0;
+
+    ~FreeList()
     {
-        return {{0, 0}, {0, 1}, {0, 2}}; // horizontal
+        if (head)
+        {
+            std::lock_guard<std::mutex> lock(sharedPool().mutex);
+            sharedPool().batches.push_back({head, size});
+            head = nullptr;
+            size = 0;
+        }
     }
-    else
+
+    void refill()
     {
-        return {{0, 0}, {1, 0}, {2, 0}}; // vertical
+        {
+            std::lock_guard<std::mutex> lock(sharedPool().mutex);
+            if (!sharedPool().batches.empty())
+            {
+                Batch batch = sharedPool().batches.back();
+                sharedPool().batches.pop_back();
+                head = batch.head;
+                size = batch.size;
+                return;
+            }
+        }
+        PoolBlock* chunk = static_cast<PoolBlock*>(
+            std::malloc(TROMINO_POOL_CHUNK * sizeof(PoolBlock)));
+        if (!chunk)
+        {
+            throw std::bad_alloc();
+        }
+        for (int i = 0; i < TROMINO_POOL_CHUNK - 1; i++)
+        {
+            chunk[i].next = &chunk[i + 1];
+        }
+        chunk[TROMINO_POOL_CHUNK - 1].next = nullptr;
+        head = chunk;
+        size = TROMINO_POOL_CHUNK;
     }
-}
 
-std::vector<Offset> LPiece::getOffsets(int rotation) const
-{
-    int r = ((rotation % 4) + 4) % 4;
-    switch (r)
+    // hands the first TROMINO_POOL_CHUNK blocks to the shared pool
+    void spill()
     {
-    case 0:
-        return {{0, 1}, {1, 0}, {1, 1}}; // missing top-left
-    case 1:
-        return {{0, 0}, {1, 0}, {1, 1}}; // missing top-right
-    case 2:
-        return {{0, 0}, {0, 1}, {1, 0}}; // missing bottom-right
-    default:
-        return {{0, 0}, {0, 1}, {1, 1}}; // missing bottom-left
+        Batch batch = {head, TROMINO_POOL_CHUNK};
+        PoolBlock* last = head;
+        for (int i = 1; i < TROMINO_POOL_CHUNK; i++)
+        {
+            last = last->next;
+        }
+        head = last->next;
+        last->next = nullptr;
+        size -= TROMINO_POOL_CHUNK;
+
+        std::lock_guard<std::mutex> lock(sharedPool().mutex);
+        sharedPool().batches.push_back(batch);
     }
+};
+
+thread_local FreeList t_freeBlocks;
+} // namespace
+
+const std::vector<Offset>& Tromino::getOffsets(int rotation) const
+{
+    const std::vector<std::vector<Offset>>& rotations =
+        PieceSet::get().getShape(type_).rotations;
+    int n = rotations.size();
+    return rotations[((rotation % n) + n) % n];
 }
 
-// Override print for IPiece
-void IPiece::print(std::ostream& os) const { os << "IPiece"; }
+int Tromino::rotationCount() const
+{
+    return PieceSet::get().getShape(type_).rotations.size();
+}
+
+void Tromino::print(std::ostream& os) const
+{
+    os << PieceSet::get().getShape(type_).name;
+}
 
-// Override print for LPiece
-void LPiece::print(std::ostream& os) const { os << "LPiece"; }
+std::unique_ptr<Tromino> Tromino::clone() const
+{
+    return std::make_unique<Tromino>(type_);
+}
+
+void* Tromino::operator new(size_t)
+{
+    FreeList& list = t_freeBlocks;
+    if (!list.head)
+    {
+        list.refill();
+    }
+    PoolBlock* block = list.head;
+    list.head = block->next;
+    list.size--;
+    return block;
+}
 
-// Implement clone for pieces
-std::unique_ptr<Tromino> IPiece::clone() const { return std::make_unique<IPiece>(*this); }
-std::unique_ptr<Tromino> LPiece::clone() const { return std::make_unique<LPiece>(*this); }
+void Tromino::operator delete(void* p)
+{
+    if (!p)
+    {
+        return;
+    }
+    FreeList& list = t_freeBlocks;
+    PoolBlock* block = static_cast<PoolBlock*>(p);
+    block->next = list.head;
+    list.head = block;
+    if (++list.size > TROMINO_LOCAL_BLOCKS)
+    {
+        list.spill();
+    }
+}
 
-// Implement operator<< for Tromino
 std::ostream& operator<<(std::ostream& os, const Tromino& piece)
 {
     piece.print(os);
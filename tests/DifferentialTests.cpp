@@ -0,0 +1,467 @@
+#include "Bellman.h"
+#include "State.h"
+#include "Tests.h"
+#include <optional>
+#include <random>
+
+// The optimized kernels against straightforward versions written from the
+// rules of the game, on random boards. The outputs must match exactly,
+// including the order of the actions. A failing board is shrunk to a
+// minimal one before being reported, `bin/tests --fuzz-cases N fuzz` runs
+// longer campaigns.
+
+#define DIFFERENTIAL_BOARDS 20000
+
+namespace
+{
+struct Case
+{
+    int width;
+    int height;
+    std::vector<uint64_t> rows;
+    int piece; // -1 for no piece
+
+    bool isFilled(int line, int column) const
+    {
+        return (rows[line] >> column) & 1ULL;
+    }
+
+    State state() const
+    {
+        Field field(width, height);
+        for (int l = 0; l < height; l++)
+        {
+            field.setRow(l, rows[l]);
+        }
+        return State(std::move(field),
+                     piece < 0 ? nullptr : std::make_unique<Tromino>(piece));
+    }
+};
+
+using Output = std::vector<int64_t>;
+
+struct Kernel
+{
+    const char* name;
+    Output (*optimized)(const State&);
+    Output (*reference)(const Case&);
+};
+
+// every anchor and rotation where the piece fits, is reachable from above
+// and rests on something, in the order of the move generator
+Output referenceActions(const Case& board)
+{
+    Output out;
+    if (board.piece < 0)
+    {
+        return out;
+    }
+    Tromino piece(board.piece);
+    auto empty = [&](int l, int c)
+    {
+        return l >= 0 && l < board.height && c >= 0 && c < board.width &&
+               !board.isFilled(l, c);
+    };
+    for (int l = 0; l < board.height; l++)
+    {
+        for (int c = 0; c < board.width; c++)
+        {
+            if (!empty(l, c))
+            {
+                continue;
+            }
+            for (int r = 0; r < piece.rotationCount(); r++)
+            {
+                bool fits = true;
+                bool rests = false;
+                for (const Offset& off : piece.getOffsets(r))
+                {
+                    int bl = l + off[0];
+                    int bc = c + off[1];
+                    if (!empty(bl, bc))
+                    {
+                        fits = false;
+                        break;
+                    }
+                    for (int above = 0; above < bl; above++)
+                    {
+                        fits = fits && !board.isFilled(above, bc);
+                    }
+                    rests = rests || bl == board.height - 1 ||
+                            board.isFilled(bl + 1, bc);
+                }
+                if (fits && rests)
+                {
+                    out.insert(out.end(), {l, c, r});
+                }
+            }
+        }
+    }
+    return out;
+}
+
+Output optimizedActions(const State& state)
+{
+    Output out;
+    for (const Action& a : state.getAvailableActions())
+    {
+        out.insert(out.end(), {a.getPosition().getX(), a.getPosition().getY(),
+                               a.getRotation()});
+    }
+    return out;
+}
+
+// full lines removed, everything above falling: the number of lines
+// cleared, then the rows
+Output referenceClear(const Case& board)
+{
+    std::vector<std::vector<bool>> kept;
+    for (int l = 0; l < board.height; l++)
+    {
+        std::vector<bool> line(board.width);
+        bool full = true;
+        for (int c = 0; c < board.width; c++)
+        {
+            line[c] = board.isFilled(l, c);
+            full = full && line[c];
+        }
+        if (!full)
+        {
+            kept.push_back(line);
+        }
+    }
+    Output out = {board.height - (int)kept.size()};
+    for (int l = 0; l < board.height - (int)kept.size(); l++)
+    {
+        out.push_back(0);
+    }
+    for (const std::vector<bool>& line : kept)
+    {
+        uint64_t row = 0;
+        for (int c = 0; c < board.width; c++)
+        {
+            row |= (uint64_t)line[c] << c;
+        }
+        out.push_back(row);
+    }
+    return out;
+}
+
+Output optimizedClear(const State& state)
+{
+    int lines;
+    State after = state.completeLines(lines);
+    Output out = {lines};
+    for (int l = 0; l < after.getField().getHeight(); l++)
+    {
+        out.push_back(after.getField().getRow(l));
+    }
+    return out;
+}
+
+Output referenceLineCount(const Case& board)
+{
+    return {referenceClear(board)[0]};
+}
+
+Output optimizedLineCount(const State& state)
+{
+    return {state.nbCompleteLines()};
+}
+
+Output referenceGaps(const Case& board)
+{
+    int holes = 0;
+    for (int c = 0; c < board.width; c++)
+    {
+        bool roof = false;
+        for (int l = 0; l < board.height; l++)
+        {
+            if (board.isFilled(l, c))
+            {
+                roof = true;
+            }
+            else if (roof)
+            {
+                holes++;
+            }
+        }
+    }
+    return {holes};
+}
+
+Output optimizedGaps(const State& state) { return {state.gapCheck()}; }
+
+// cells in row-major order, times the number of piece codes, plus the
+// piece code; -1 when that does not fit in 64 bits
+Output referenceHash(const Case& board)
+{
+    int cells = board.width * board.height;
+    uint64_t nbCodes = PieceSet::get().size() + 1;
+    if (cells >= 64 || (~0ULL >> cells) < nbCodes)
+    {
+        return {-1};
+    }
+    uint64_t mask = 0;
+    for (int l = 0; l < board.height; l++)
+    {
+        for (int c = 0; c < board.width; c++)
+        {
+            mask |= (uint64_t)board.isFilled(l, c) << (l * board.width + c);
+        }
+    }
+    return {(int64_t)(mask * nbCodes + board.piece + 1)};
+}
+
+Output optimizedHash(const State& state) { return {(int64_t)state.hash()}; }
+
+const Kernel kernels[] = {
+    {"getAvailableActions", optimizedActions, referenceActions},
+    {"completeLines", optimizedClear, referenceClear},
+    {"nbCompleteLines", optimizedLineCount, referenceLineCount},
+    {"gapCheck", optimizedGaps, referenceGaps},
+    {"hash", optimizedHash, referenceHash},
+};
+
+// some full lines and a ragged top, any piece or none
+Case randomCase(std::mt19937& rng, int width, int height)
+{
+    Case c = {width, height, {}, 0};
+    c.piece = rng() % (PieceSet::get().size() + 1) - 1;
+    uint64_t full = ~0ULL >> (64 - width);
+    int top = rng() % (height + 1);
+    int density = rng() % 4; // sparse to full rows
+    for (int l = 0; l < height; l++)
+    {
+        uint64_t row = 0;
+        if (l >= top)
+        {
+            row = rng() % 4 == 0 ? full : ((uint64_t)rng() << 32) | rng();
+            for (int d = 0; d < density; d++)
+            {
+                row |= ((uint64_t)rng() << 32) | rng();
+            }
+        }
+        c.rows.push_back(row & full);
+    }
+    return c;
+}
+
+// mostly small boards where every piece has moves, sometimes wide ones for
+// the line and word operations
+Case randomCase(std::mt19937& rng)
+{
+    bool wide = rng() % 8 == 0;
+    int width = wide ? 1 + rng() % MAX_FIELD_WIDTH : 1 + rng() % 12;
+    int height = wide ? 1 + rng() % 24 : 1 + rng() % 12;
+    return randomCase(rng, width, height);
+}
+
+// smaller variants of a case: one line or column less, one cell emptied,
+// a lower piece
+std::vector<Case> shrinkCandidates(const Case& c)
+{
+    std::vector<Case> candidates;
+    for (int l = 0; l < c.height && c.height > 1; l++)
+    {
+        Case smaller = c;
+        smaller.height--;
+        smaller.rows.erase(smaller.rows.begin() + l);
+        candidates.push_back(smaller);
+    }
+    for (int col = 0; col < c.width && c.width > 1; col++)
+    {
+        Case smaller = c;
+        smaller.width--;
+        uint64_t low = (1ULL << col) - 1;
+        for (uint64_t& row : smaller.rows)
+        {
+            row = (row & low) | ((row >> (col + 1)) << col);
+        }
+        candidates.push_back(smaller);
+    }
+    for (int l = 0; l < c.height; l++)
+    {
+        for (int col = 0; col < c.width; col++)
+        {
+            if (c.isFilled(l, col))
+            {
+                Case smaller = c;
+                smaller.rows[l] &= ~(1ULL << col);
+                candidates.push_back(smaller);
+            }
+        }
+    }
+    if (c.piece >= 0)
+    {
+        Case smaller = c;
+        smaller.piece--;
+        candidates.push_back(smaller);
+    }
+    return candidates;
+}
+
+bool differs(const Kernel& kernel, const Case& c)
+{
+    return kernel.optimized(c.state()) != kernel.reference(c);
+}
+
+// greedy: keeps the first smaller case that still fails until none does
+Case shrink(const Kernel& kernel, Case c)
+{
+    bool shrunk = true;
+    while (shrunk)
+    {
+        shrunk = false;
+        for (const Case& smaller : shrinkCandidates(c))
+        {
+            if (differs(kernel, smaller))
+            {
+                c = smaller;
+                shrunk = true;
+                break;
+            }
+        }
+    }
+    return c;
+}
+
+std::string describe(const Output& out)
+{
+    std::ostringstream os;
+    for (int64_t v : out)
+    {
+        os << " " << v;
+    }
+    return os.str();
+}
+
+std::string describe(const Kernel& kernel, const Case& c)
+{
+    std::ostringstream os;
+    os << kernel.name << " differs on " << c.width << "x" << c.height
+       << " board, piece " << c.piece << "\n";
+    for (int l = 0; l < c.height; l++)
+    {
+        os << "    ";
+        for (int col = 0; col < c.width; col++)
+        {
+            os << (c.isFilled(l, col) ? '#' : '.');
+        }
+        os << "\n";
+    }
+    os << "    optimized:" << describe(kernel.optimized(c.state())) << "\n"
+       << "    reference:" << describe(kernel.reference(c));
+    return os.str();
+}
+
+// returns the shrunk failing case, if any
+std::optional<Case> fuzz(const Kernel& kernel, uint32_t seed, int cases)
+{
+    std::mt19937 rng(seed);
+    for (int i = 0; i < cases; i++)
+    {
+        Case c = randomCase(rng);
+        if (differs(kernel, c))
+        {
+            return shrink(kernel, c);
+        }
+    }
+    return std::nullopt;
+}
+
+// a gapCheck that misses holes right under the top of a column
+Output brokenGaps(const State& state)
+{
+    const Field& field = state.getField();
+    int holes = state.gapCheck();
+    for (int l = 1; l < field.getHeight(); l++)
+    {
+        holes -= __builtin_popcountll(field.getRow(l - 1) & ~field.getRow(l));
+    }
+    return {holes};
+}
+} // namespace
+
+TEST(fuzzKernelsMatchReference)
+{
+    for (PieceSet set : {PieceSet::trominoes(), PieceSet::tetrominoes()})
+    {
+        PieceSetGuard pieces(set);
+        for (const Kernel& kernel : kernels)
+        {
+            std::optional<Case> failure =
+                fuzz(kernel, 2024, fuzzCases(DIFFERENTIAL_BOARDS));
+            if (failure)
+            {
+                testFailure(__FILE__, __LINE__, describe(kernel, *failure));
+            }
+        }
+    }
+}
+
+TEST(fuzzShrinksFailures)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    Kernel broken = {"brokenGaps", brokenGaps, referenceGaps};
+    std::optional<Case> failure = fuzz(broken, 7, DIFFERENTIAL_BOARDS);
+    CHECK(failure.has_value());
+    if (failure)
+    {
+        // one filled cell over an empty one is the smallest counterexample
+        CHECK_EQ(failure->width, 1);
+        CHECK_EQ(failure->height, 2);
+        CHECK_EQ(failure->rows[0], 1ULL);
+        CHECK_EQ(failure->rows[1], 0ULL);
+        CHECK_EQ(failure->piece, -1);
+    }
+}
+
+TEST(keyRoundTrip)
+{
+    std::mt19937 rng(56);
+    for (int i = 0; i < DIFFERENTIAL_BOARDS; i++)
+    {
+        int width = 2 + rng() % 6;
+        int height = 2 + rng() % (60 / width - 1);
+        State state = randomCase(rng, width, height).state();
+        State back = State::fromKey(state.key(), width, height);
+        CHECK(back == state);
+        CHECK_EQ(back.key(), state.key());
+    }
+}
+
+TEST(bellmanKernelsMatchScalar)
+{
+    std::mt19937 rng(78);
+    std::uniform_real_distribution<double> real(-10.0, 10.0);
+    for (int i = 0; i < 200; i++)
+    {
+        size_t n = rng() % 100;
+        int nbStates = 1 + rng() % 50;
+        std::vector<int32_t> next(n);
+        std::vector<double> reward(n), coef(n), V(nbStates);
+        for (size_t t = 0; t < n; t++)
+        {
+            next[t] = rng() % nbStates;
+            reward[t] = real(rng);
+            coef[t] = real(rng);
+        }
+        for (double& v : V)
+        {
+            v = real(rng);
+        }
+
+        std::vector<double> expected(n);
+        BellmanBackup::kernels().back().run(next.data(), reward.data(),
+                                            coef.data(), V.data(), n,
+                                            expected.data());
+        for (const BellmanBackup::Kernel& kernel : BellmanBackup::kernels())
+        {
+            std::vector<double> out(n);
+            kernel.run(next.data(), reward.data(), coef.data(), V.data(), n,
+                       out.data());
+            CHECK(out == expected);
+        }
+    }
+}
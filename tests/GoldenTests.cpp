@@ -0,0 +1,985 @@
+#include "Checkpoint.h"
+#include "Expectimax.h"
+#include "GraphExport.h"
+#include "MCTS.h"
+#include "MDP.h"
+#include "PolicyServer.h"
+#include "Tests.h"
+#include "Trace.h"
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// Values recorded from the implementation when the suite was written, so
+// that optimizations are checked against it. Regenerate with
+// `bin/tests --update-golden` only when a change of results is intended.
+
+#define GOLDEN_DIR "tests/golden/"
+#define GOLDEN_TOLERANCE 1e-6
+#define LAMBDA 0.9
+#define ADVERSARY_LAMBDA 0.1
+#define EPSILON 1e-8
+#define MAX_IT 1000
+#define MCTS_GAMES 4
+#define MCTS_ITERATIONS 50
+#define FITTED_ITERATIONS 10
+#define FITTED_BATCH 1000
+#define FITTED_RANDOM_GAMES 20
+// relative gap allowed between the fitted and the exact greedy policy
+#define FITTED_MARGIN 0.01
+
+namespace
+{
+class Golden
+{
+  private:
+    std::string path_;
+    std::map<std::string, std::string> values_;
+
+  public:
+    explicit Golden(std::string path) : path_(GOLDEN_DIR + path)
+    {
+        std::ifstream in(path_);
+        std::string name, value;
+        while (in >> name >> value)
+        {
+            values_[name] = value;
+        }
+        if (values_.empty() && !updatingGolden())
+        {
+            testFailure(__FILE__, __LINE__, "missing golden file " + path_);
+        }
+    }
+
+    ~Golden()
+    {
+        if (updatingGolden())
+        {
+            std::ofstream out(path_);
+            for (const auto& [name, value] : values_)
+            {
+                out << name << " " << value << "\n";
+            }
+        }
+    }
+
+    void check(const std::string& name, uint64_t value)
+    {
+        if (updatingGolden())
+        {
+            values_[name] = std::to_string(value);
+            return;
+        }
+        auto it = values_.find(name);
+        if (it == values_.end() || std::stoull(it->second) != value)
+        {
+            testFailure(__FILE__, __LINE__,
+                        path_ + " " + name + ": got " + std::to_string(value) +
+                            ", expected " +
+                            (it == values_.end() ? "nothing" : it->second));
+        }
+    }
+
+    void check(const std::string& name, double value)
+    {
+        if (updatingGolden())
+        {
+            std::ostringstream os;
+            os.precision(17);
+            os << value;
+            values_[name] = os.str();
+            return;
+        }
+        auto it = values_.find(name);
+        double expected = it == values_.end() ? NAN : std::stod(it->second);
+        if (!(std::abs(value - expected) <=
+              GOLDEN_TOLERANCE * std::max(1.0, std::abs(expected))))
+        {
+            std::ostringstream os;
+            os.precision(17);
+            os << path_ << " " << name << ": got " << value << ", expected "
+               << expected;
+            testFailure(__FILE__, __LINE__, os.str());
+        }
+    }
+};
+
+uint64_t checksum(const std::vector<uint8_t>& bytes)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (uint8_t b : bytes)
+    {
+        h = (h ^ b) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t checksum(const std::vector<int8_t>& pieces)
+{
+    return checksum(std::vector<uint8_t>(pieces.begin(), pieces.end()));
+}
+
+// header and raw elements of a .npy file
+std::pair<std::string, std::string> readNpy(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    if (bytes.size() < 10 || bytes.compare(0, 8, "\x93NUMPY\x01\x00", 8) != 0)
+    {
+        return {};
+    }
+    size_t length = (uint8_t)bytes[8] | (uint8_t)bytes[9] << 8;
+    return {bytes.substr(10, length), bytes.substr(10 + length)};
+}
+
+template <typename T>
+bool sameBytes(const std::string& raw, const std::vector<T>& values)
+{
+    return raw.size() == values.size() * sizeof(T) &&
+           std::memcmp(raw.data(), values.data(), raw.size()) == 0;
+}
+
+// the solvers start with an I piece as in bin/tetris, exploration counts
+// start without piece
+State emptyState(int width, int height, int piece = -1)
+{
+    if (piece < 0)
+    {
+        return State(Field(width, height), nullptr);
+    }
+    return State(Field(width, height), std::make_unique<Tromino>(piece));
+}
+// score of up to moves moves of a player, with random pieces
+int playMoves(Player& player, int width, int height, int moves)
+{
+    State curr(Field(width, height),
+               std::make_unique<Tromino>(PieceSet::get().draw()));
+    int score = 0;
+    for (int m = 0; m < moves && !curr.getAvailableActions().empty(); m++)
+    {
+        Action a = player.chooseAction(curr);
+        State placed =
+            curr.applyActionTromino(a, Tromino(PieceSet::get().draw()));
+        score += placed.evaluate();
+        curr = placed.completeLines();
+    }
+    return score;
+}
+// uniform over the available actions, the floor any search must beat
+class RandomPlayer : public Player
+{
+  public:
+    Action chooseAction(const State& state) override
+    {
+        std::vector<Action> actions = state.getAvailableActions();
+        return actions[rand() % actions.size()];
+    }
+};
+
+// whether run() stops the program with exit(1), as the repo does on bad
+// input; it runs in a child process with its messages silenced
+bool exitsWithError(const std::function<void()>& run)
+{
+    std::cout.flush();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        std::freopen("/dev/null", "w", stderr);
+        run();
+        _exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 1;
+}
+} // namespace
+
+TEST(reachableStatesTrominoes)
+{
+    Golden golden("reachable.txt");
+    for (auto [w, h] : {std::pair{3, 3}, {3, 4}, {4, 4}, {4, 5}})
+    {
+        PieceSetGuard pieces(PieceSet::trominoes());
+        StateGraph graph(emptyState(w, h), 4);
+        std::string board = std::to_string(w) + "x" + std::to_string(h);
+        golden.check("trominoes_" + board + "_states", (uint64_t)graph.size());
+        golden.check("trominoes_" + board + "_actions",
+                     (uint64_t)graph.nbActions());
+    }
+}
+
+TEST(reachableStatesTetrominoes)
+{
+    Golden golden("reachable.txt");
+    PieceSetGuard pieces(PieceSet::tetrominoes());
+    StateGraph graph(emptyState(4, 4), 4);
+    golden.check("tetrominoes_4x4_states", (uint64_t)graph.size());
+    golden.check("tetrominoes_4x4_actions", (uint64_t)graph.nbActions());
+}
+
+TEST(graphMatchesMapExploration)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(3, 4, emptyState(3, 4));
+    std::unordered_map<State, double> states =
+        mdp.generateReachableStates(emptyState(3, 4));
+    const StateGraph& graph = mdp.getGraph();
+    CHECK_EQ((int)states.size(), graph.size());
+    for (int s = 0; s < graph.size(); s++)
+    {
+        CHECK(states.count(graph.getState(s)) == 1);
+        CHECK_EQ(graph.getState(s).key(), graph.getKey(s));
+    }
+}
+
+TEST(graphExportRoundTrip)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    StateGraph graph(emptyState(3, 4, I_PIECE), 1);
+    std::string dir =
+        (std::filesystem::temp_directory_path() / "tetris_export_test").string();
+    exportGraph(graph, dir);
+
+    auto [keysHeader, keys] = readNpy(dir + "/keys.npy");
+    CHECK_EQ(keysHeader.size() % 64, (size_t)54);
+    CHECK(keysHeader.find("'descr': '<u8'") != std::string::npos);
+    CHECK(keysHeader.find("'shape': (" + std::to_string(graph.size()) +
+                          ",)") != std::string::npos);
+    CHECK(sameBytes(keys, graph.getKeys()));
+    CHECK(sameBytes(readNpy(dir + "/action_offsets.npy").second,
+                    graph.getActionOffsets()));
+
+    std::vector<int32_t> next;
+    std::vector<uint8_t> gaps;
+    std::vector<double> probabilities;
+    for (size_t t = 0; t < graph.getTransitions().size(); t++)
+    {
+        next.push_back(graph.getTransitions()[t].next);
+        gaps.push_back(graph.getTransitions()[t].gaps);
+        probabilities.push_back(
+            PieceSet::get().getProbability(t % graph.getNbPieces()));
+    }
+    auto [nextHeader, nextRaw] = readNpy(dir + "/next.npy");
+    CHECK(nextHeader.find("'shape': (" + std::to_string(graph.nbActions()) +
+                          ", 2)") != std::string::npos);
+    CHECK(sameBytes(nextRaw, next));
+    CHECK(sameBytes(readNpy(dir + "/gaps.npy").second, gaps));
+    CHECK(sameBytes(readNpy(dir + "/probabilities.npy").second, probabilities));
+
+    std::string actions = readNpy(dir + "/actions.npy").second;
+    CHECK_EQ(actions.size(), graph.nbActions() * 3);
+    for (size_t k = 0; k < graph.nbActions() && actions.size() >= 3 * k + 3;
+         k++)
+    {
+        CHECK_EQ((int)actions[3 * k + 2], graph.getAction(k).getRotation());
+    }
+
+    // a short array is an error on close(), only a warning when the
+    // writer is dropped without it
+    int32_t one = 1;
+    std::string shortPath = dir + "/short.npy";
+    CHECK(exitsWithError(
+        [&]
+        {
+            NpyWriter writer(shortPath, "<i4", {2});
+            writer.write(&one, 1);
+            writer.close();
+        }));
+    CHECK(!exitsWithError(
+        [&]
+        {
+            NpyWriter writer(shortPath, "<i4", {2});
+            writer.write(&one, 1);
+        }));
+    std::filesystem::remove_all(dir);
+}
+
+TEST(traceRoundTrip)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(3, 4, emptyState(3, 4, I_PIECE));
+    std::unordered_map<State, Action> policy =
+        mdp.acceleratedActionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT,
+                                            5);
+    std::unordered_map<State, std::unique_ptr<Tromino>> random;
+    Field field(3, 4);
+    Game game(field);
+    std::string path =
+        (std::filesystem::temp_directory_path() / "tetris_trace_test.trc")
+            .string();
+
+    TraceRecorder::open(path, 3, 4);
+    int scores[2] = {mdp.playPolicy(game, policy, random),
+                     mdp.playPolicy(game, policy, random)};
+    TraceRecorder::close();
+    CHECK(!TraceRecorder::enabled());
+
+    TraceFile trace = readTrace(path);
+    CHECK_EQ(trace.width, 3);
+    CHECK_EQ(trace.height, 4);
+    CHECK_EQ(trace.records.size(), (size_t)2 * MAX_ACTION);
+    int totals[2] = {0, 0};
+    for (size_t i = 0; i < trace.records.size(); i++)
+    {
+        const TraceRecord& r = trace.records[i];
+        uint32_t game = r.game - trace.records[0].game;
+        CHECK(game < 2);
+        totals[game % 2] += r.gain;
+
+        // replaying a move leads to the state recorded by the next one
+        State curr = State::fromKey(r.key, 3, 4);
+        Action action(Point(r.line, r.column), r.rotationPiece & 0xF);
+        State placed =
+            curr.applyActionTromino(action, Tromino(r.rotationPiece >> 4));
+        CHECK_EQ(placed.evaluate(), (int)r.gain);
+        if (i + 1 < trace.records.size() && trace.records[i + 1].game == r.game)
+        {
+            CHECK_EQ(placed.completeLines().key(), trace.records[i + 1].key);
+        }
+    }
+    CHECK_EQ(totals[0], scores[0]);
+    CHECK_EQ(totals[1], scores[1]);
+    std::filesystem::remove(path);
+}
+
+TEST(policyServerAnswersQueries)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(3, 4, emptyState(3, 4, I_PIECE));
+    GameSolution game = mdp.gameValueIteration(EPSILON, MAX_IT, LAMBDA);
+    const StateGraph& graph = mdp.getGraph();
+    CompactPolicy policy = mdp.compactPolicy(game.actions);
+    std::vector<int8_t> adversary = mdp.compileAdversary(game.trominos);
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string tablePath = (dir / "tetris_policy_test.tbl").string();
+    std::string socketPath = (dir / "tetris_policy_test.sock").string();
+    writePolicyTable(tablePath, graph, policy, adversary);
+
+    PolicyTable table(tablePath);
+    PolicyServer server(table, socketPath);
+    std::thread serving([&] { server.run(); });
+
+    std::vector<uint64_t> keys = graph.getKeys();
+    keys.push_back(~0ULL);
+    // clients at once, each with the keys in its own order
+    std::vector<std::vector<PolicyAnswer>> answers(4);
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < answers.size(); c++)
+    {
+        clients.emplace_back(
+            [&, c]
+            {
+                PolicyClient client(socketPath);
+                std::vector<uint64_t> mine(keys.rbegin(), keys.rend());
+                if (c % 2 == 0)
+                {
+                    mine = keys;
+                }
+                answers[c] = client.query(mine);
+                if (c % 2 == 1)
+                {
+                    std::reverse(answers[c].begin(), answers[c].end());
+                }
+            });
+    }
+    for (std::thread& t : clients)
+    {
+        t.join();
+    }
+    std::vector<int32_t> info = PolicyClient(socketPath).info();
+    server.stop();
+    serving.join();
+
+    CHECK(info == std::vector<int32_t>({3, 4, 2, graph.size()}));
+    for (const std::vector<PolicyAnswer>& got : answers)
+    {
+        CHECK_EQ(got.size(), keys.size());
+        if (got.size() != keys.size())
+        {
+            continue;
+        }
+        for (int s = 0; s < graph.size(); s++)
+        {
+            int k = policy.getActionId(graph, s);
+            CHECK_EQ((int)got[s].piece, (int)adversary[s]);
+            CHECK_EQ((int)got[s].rotation,
+                     k < 0 ? NO_ANSWER_ACTION
+                           : graph.getAction(k).getRotation());
+            if (k >= 0)
+            {
+                CHECK_EQ((int)got[s].line,
+                         graph.getAction(k).getPosition().getX());
+                CHECK_EQ((int)got[s].column,
+                         graph.getAction(k).getPosition().getY());
+            }
+        }
+        CHECK_EQ((int)got.back().rotation, UNKNOWN_STATE);
+    }
+    std::filesystem::remove(tablePath);
+}
+
+TEST(policyServerHoldsBackUnreadClients)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(3, 3, emptyState(3, 3, I_PIECE));
+    GameSolution game = mdp.gameValueIteration(EPSILON, MAX_IT, LAMBDA);
+    const StateGraph& graph = mdp.getGraph();
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string tablePath = (dir / "tetris_policy_unread.tbl").string();
+    std::string socketPath = (dir / "tetris_policy_unread.sock").string();
+    writePolicyTable(tablePath, graph, mdp.compactPolicy(game.actions),
+                     mdp.compileAdversary(game.trominos));
+    PolicyTable table(tablePath);
+
+    // only a stale socket may be replaced
+    std::string filePath = (dir / "tetris_policy_not_a_socket").string();
+    std::ofstream(filePath) << "keep me";
+    CHECK(exitsWithError([&] { PolicyServer server(table, filePath); }));
+    CHECK(std::filesystem::is_regular_file(filePath));
+    std::filesystem::remove(filePath);
+
+    PolicyServer server(table, socketPath);
+    std::thread serving([&] { server.run(); });
+
+    uint64_t key = graph.getKey(graph.size() - 1);
+    uint32_t count = MAX_QUERY_BATCH;
+    std::vector<char> request(sizeof(count) + count * sizeof(uint64_t));
+    std::memcpy(request.data(), &count, sizeof(count));
+    for (uint32_t q = 0; q < count; q++)
+    {
+        std::memcpy(&request[sizeof(count) + q * sizeof(uint64_t)], &key,
+                    sizeof(key));
+    }
+
+    // a client that only writes must eventually be blocked by the server
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socketPath.c_str());
+    CHECK(connect(fd, reinterpret_cast<sockaddr*>(&address),
+                  sizeof(address)) == 0);
+    size_t limit = 64 * request.size(), sent = 0;
+    while (sent < limit)
+    {
+        size_t offset = sent % request.size();
+        ssize_t n = send(fd, &request[offset], request.size() - offset,
+                         MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            // let the server fill its queue before giving up
+            pollfd out = {fd, POLLOUT, 0};
+            if (poll(&out, 1, 200) == 0)
+            {
+                break;
+            }
+            continue;
+        }
+        sent += n;
+    }
+    CHECK(sent < limit);
+
+    // once it reads again every request is answered
+    fcntl(fd, F_SETFL, 0);
+    size_t requests = (sent + request.size() - 1) / request.size();
+    std::thread rest(
+        [&]
+        {
+            // requests end on a boundary, so no send goes past it
+            while (sent < requests * request.size())
+            {
+                size_t offset = sent % request.size();
+                ssize_t n = send(fd, &request[offset], request.size() - offset,
+                                 MSG_NOSIGNAL);
+                if (n <= 0)
+                {
+                    break;
+                }
+                sent += n;
+            }
+        });
+    std::vector<PolicyAnswer> answers(requests * count);
+    char* p = reinterpret_cast<char*>(answers.data());
+    size_t bytes = answers.size() * sizeof(PolicyAnswer);
+    while (bytes > 0)
+    {
+        ssize_t n = read(fd, p, bytes);
+        CHECK(n > 0);
+        if (n <= 0)
+        {
+            break;
+        }
+        p += n;
+        bytes -= n;
+    }
+    rest.join();
+    close(fd);
+    server.stop();
+    serving.join();
+
+    PolicyAnswer expected = table.query(key);
+    CHECK_EQ(bytes, 0UL);
+    CHECK(std::all_of(answers.begin(), answers.end(),
+                      [&](const PolicyAnswer& a)
+                      {
+                          return std::memcmp(&a, &expected, sizeof(a)) == 0;
+                      }));
+    std::filesystem::remove(tablePath);
+}
+
+TEST(renumberingKeepsValues)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(3, 4, emptyState(3, 4, I_PIECE));
+    std::unordered_map<State, Action> before =
+        mdp.acceleratedActionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT,
+                                            5);
+    double score = mdp.compilePolicy(before).expectedScore(
+        std::vector<int8_t>(mdp.getGraph().size(), RANDOM_PIECE), MAX_ACTION);
+
+    for (StateOrder order : {ORDER_RCM, ORDER_HEIGHT})
+    {
+        StateGraph graph(emptyState(3, 4, I_PIECE), 1);
+        graph.renumber(order);
+        for (int s = 0; s < graph.size(); s++)
+        {
+            CHECK_EQ(graph.find(graph.getKey(s)), s);
+        }
+        CompiledPolicy policy(graph, emptyState(3, 4, I_PIECE), before);
+        CHECK_NEAR(policy.expectedScore(
+                       std::vector<int8_t>(graph.size(), RANDOM_PIECE),
+                       MAX_ACTION),
+                   score, 1e-9 * score);
+    }
+}
+
+TEST(actionPoliciesAndValues)
+{
+    Golden golden("solvers_4x4.txt");
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(4, 4, emptyState(4, 4, I_PIECE));
+    std::vector<int8_t> random(mdp.getGraph().size(), RANDOM_PIECE);
+
+    std::unordered_map<State, Action> exact =
+        mdp.actionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT);
+    golden.check("exact_policy", checksum(mdp.compactPolicy(exact).getIndices()));
+    golden.check("exact_expected_random",
+                 mdp.compilePolicy(exact).expectedScore(random, MAX_ACTION));
+
+    std::unordered_map<State, Action> accelerated =
+        mdp.acceleratedActionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT,
+                                            5);
+    golden.check("accelerated_expected_random",
+                 mdp.compilePolicy(accelerated)
+                     .expectedScore(random, MAX_ACTION));
+
+    std::unordered_map<State, Action> features =
+        mdp.acceleratedActionValueIteration(LAMBDA, 1, 0.5, 1, 0.5, EPSILON,
+                                            MAX_IT, 5);
+    golden.check("features_policy",
+                 checksum(mdp.compactPolicy(features).getIndices()));
+    golden.check("features_expected_random",
+                 mdp.compilePolicy(features).expectedScore(random, MAX_ACTION));
+}
+
+TEST(fusedAdversariesMatchSeparate)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(4, 4, emptyState(4, 4, I_PIECE));
+    AdversarySolution fused =
+        mdp.adversaryValueIteration(EPSILON, MAX_IT, ADVERSARY_LAMBDA, 4);
+
+    CHECK(mdp.compileAdversary(fused.minAvg) ==
+          mdp.compileAdversary(mdp.trominoValueIterationMinAvg(
+              EPSILON, MAX_IT, ADVERSARY_LAMBDA)));
+    CHECK(mdp.compileAdversary(fused.gapAvg) ==
+          mdp.compileAdversary(mdp.trominoValueIterationGapAvg(
+              EPSILON, MAX_IT, ADVERSARY_LAMBDA)));
+
+    // MinMax has exact ties that the sweep order breaks differently, the
+    // adversaries must still be worth the same against a policy
+    CompiledPolicy policy = mdp.compilePolicy(mdp.acceleratedActionValueIteration(
+        LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT, 5));
+    CHECK_NEAR(policy.expectedScore(mdp.compileAdversary(fused.minMax),
+                                    MAX_ACTION),
+               policy.expectedScore(
+                   mdp.compileAdversary(mdp.trominoValueIterationMinMax(
+                       EPSILON, MAX_IT, ADVERSARY_LAMBDA)),
+                   MAX_ACTION),
+               1e-6);
+}
+
+TEST(heuristicSearchMatchesValueIteration)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(4, 4, emptyState(4, 4, I_PIECE));
+    std::vector<int8_t> random(mdp.getGraph().size(), RANDOM_PIECE);
+
+    std::unordered_map<State, Action> exact =
+        mdp.acceleratedActionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT,
+                                            5);
+    std::unordered_map<State, Action> searched =
+        mdp.heuristicSearch(LAMBDA, 0, 0, 1, 0, EPSILON, 1000000);
+    CHECK((int)searched.size() < mdp.getGraph().size());
+    CHECK_NEAR(mdp.compilePolicy(searched).expectedScore(random, MAX_ACTION),
+               mdp.compilePolicy(exact).expectedScore(random, MAX_ACTION),
+               1e-6);
+}
+
+TEST(scoreDistributionMatchesExpectation)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    for (auto [w, h] : {std::pair{3, 3}, {4, 4}})
+    {
+        MDP mdp(w, h, emptyState(w, h, I_PIECE));
+        CompiledPolicy policy =
+            mdp.compilePolicy(mdp.acceleratedActionValueIteration(
+                LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT, 5));
+        std::vector<int8_t> random(mdp.getGraph().size(), RANDOM_PIECE);
+
+        for (int nbThreads : {1, 3})
+        {
+            GameDistribution d = policy.distribution(random, 300, nbThreads);
+            double total = 0.0, lengths = 0.0;
+            for (double p : d.score)
+            {
+                total += p;
+            }
+            for (double p : d.length)
+            {
+                lengths += p;
+            }
+            CHECK_NEAR(total + d.truncated, 1.0, 1e-12);
+            CHECK_NEAR(lengths, 1.0, 1e-12);
+            CHECK_NEAR(d.meanScore(), policy.expectedScore(random, 300), 1e-6);
+            CHECK(d.scoreQuantile(0.01) <= d.scoreQuantile(0.5));
+            CHECK(d.scoreQuantile(0.5) <= d.scoreQuantile(0.99));
+        }
+    }
+}
+
+TEST(finiteHorizonEarlyStop)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(4, 4, emptyState(4, 4, I_PIECE));
+    std::vector<int8_t> random(mdp.getGraph().size(), RANDOM_PIECE);
+    int horizon = 500;
+
+    // a negative epsilon never stops early
+    FiniteHorizonSolution full =
+        mdp.finiteHorizonIteration(0, 0, 1, 0, horizon, -1.0, 5);
+    FiniteHorizonSolution early =
+        mdp.finiteHorizonIteration(0, 0, 1, 0, horizon, 1e-9, 5);
+    CHECK_EQ(full.steps, horizon);
+    CHECK(early.steps < horizon);
+    CHECK_EQ((int)early.tail.size(), 5);
+    CHECK_EQ(full.error, 0.0);
+    CHECK_EQ(early.error, (horizon - early.steps) * 1e-9);
+    CHECK_NEAR(early.value, full.value, early.error);
+
+    // no stationary policy does better over the same horizon
+    double discounted =
+        mdp.compilePolicy(mdp.acceleratedActionValueIteration(
+                              LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT, 5))
+            .expectedScore(random, horizon);
+    double stationary =
+        mdp.compilePolicy(early.policy).expectedScore(random, horizon);
+    CHECK(discounted <= full.value + 1e-9);
+    CHECK(stationary <= full.value + 1e-9);
+}
+
+TEST(expectimaxReachesValueIteration)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    std::string path =
+        (std::filesystem::temp_directory_path() / "tetris_expectimax.ckpt")
+            .string();
+    for (auto [width, height] : {std::pair(3, 3), std::pair(4, 4)})
+    {
+        // the values of the solve are the leaves of the search
+        MDP mdp(width, height, emptyState(width, height, I_PIECE));
+        mdp.setCheckpoint(path, MAX_IT);
+        std::unordered_map<State, Action> policy =
+            mdp.actionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT);
+        double expected = mdp.compilePolicy(policy).expectedScore(
+            std::vector<int8_t>(mdp.getGraph().size(), RANDOM_PIECE), 2000);
+        Checkpoint checkpoint = Checkpoint::load(path);
+        auto values = std::make_shared<std::unordered_map<uint64_t, double>>();
+        for (size_t i = 0; i < checkpoint.keys.size(); i++)
+        {
+            (*values)[checkpoint.keys[i]] = checkpoint.values[i];
+        }
+
+        for (int depth : {1, 2})
+        {
+            srand(depth);
+            Expectimax player(depth, 0, LAMBDA, [values](const State& state)
+                              { return values->at(state.key()); });
+            CHECK_NEAR(playMoves(player, width, height, 2000), expected,
+                       0.05 * expected);
+            CHECK_EQ(player.getLastDepth(), depth);
+        }
+    }
+    std::filesystem::remove(path);
+
+    // a block over a hole on the two bottom lines: height 2, one gap, so
+    // 0.5 * (4 + 1 - 2) + 2 * (16 - 1)
+    Field field(4, 4);
+    field.setRow(2, 0b0010);
+    field.setRow(3, 0b1101);
+    CHECK_EQ(Expectimax::featureEvaluator(0.5, 2)(State(std::move(field),
+                                                        nullptr)),
+             31.5);
+
+    // game over is worth 0 at every depth, the evaluator only sees
+    // living boards
+    long leaves = 0, deadLeaves = 0;
+    Expectimax counting(2, 0, LAMBDA,
+                        [&](const State& state)
+                        {
+                            leaves++;
+                            deadLeaves += state.getAvailableActions().empty();
+                            return 1.0;
+                        });
+    srand(3);
+    playMoves(counting, 3, 3, 2000);
+    CHECK(leaves > 0);
+    CHECK_EQ(deadLeaves, 0L);
+}
+
+TEST(mctsBeatsRandomPlayer)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(3, 3, emptyState(3, 3, I_PIECE));
+    Field field(3, 3);
+    Game game(field);
+    std::unordered_map<State, std::unique_ptr<Tromino>> random;
+
+    // the same pieces for both players: each game reseeds rand()
+    int mctsTotal = 0, randomTotal = 0;
+    for (int g = 0; g < MCTS_GAMES; g++)
+    {
+        srand(g + 1);
+        RandomPlayer randomPlayer;
+        randomTotal += mdp.playPolicy(game, randomPlayer, random);
+
+        srand(g + 1);
+        MCTS mcts(2, MCTS_ITERATIONS, 0, 1.0, LAMBDA, 5, nullptr);
+        mctsTotal += mdp.playPolicy(game, mcts, random);
+    }
+    std::cout << "  mean score: " << (double)mctsTotal / MCTS_GAMES
+              << " MCTS, " << (double)randomTotal / MCTS_GAMES << " random"
+              << std::endl;
+    CHECK(mctsTotal > 10 * randomTotal);
+
+    // the threads grow separate trees from seeds drawn up front, so the
+    // scheduling does not change the game
+    int scores[2];
+    for (int& score : scores)
+    {
+        srand(1);
+        MCTS mcts(2, MCTS_ITERATIONS, 0, 1.0, LAMBDA, 5, nullptr);
+        score = mdp.playPolicy(game, mcts, random);
+    }
+    CHECK_EQ(scores[0], scores[1]);
+
+    // without a time budget every thread runs all of its iterations
+    MCTS mcts(2, MCTS_ITERATIONS, 0, 1.0, LAMBDA, 5, nullptr);
+    mcts.chooseAction(emptyState(3, 3, I_PIECE));
+    CHECK_EQ(mcts.getLastIterations(), 2L * MCTS_ITERATIONS);
+}
+
+TEST(linearValueRoundTrip)
+{
+    std::string path =
+        (std::filesystem::temp_directory_path() / "tetris_weights.txt")
+            .string();
+    // weights whose shortest decimal form is not exact
+    LinearValue saved({0.1, 1.0 / 3, -2.0 / 7, 1e-300, -123456.789012345678,
+                       M_PI, 0.0});
+    saved.save(path);
+    LinearValue loaded = LinearValue::load(path);
+    CHECK(loaded.getWeights() == saved.getWeights());
+    std::filesystem::remove(path);
+
+    // a block over a hole on the two bottom lines
+    Field field(4, 4);
+    field.setRow(2, 0b0010);
+    field.setRow(3, 0b1101);
+    CHECK(LinearValue::features(State(std::move(field), nullptr)) ==
+          std::vector<double>({1, 1, 2, 1, 1, 2, 1, 2}));
+}
+
+TEST(fittedValueNearValueIteration)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(3, 3, emptyState(3, 3, I_PIECE));
+    const StateGraph& graph = mdp.getGraph();
+    std::vector<int8_t> random(graph.size(), RANDOM_PIECE);
+    double exact = mdp.compilePolicy(mdp.actionValueIteration(
+                                         LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT))
+                       .expectedScore(random, 2000);
+
+    // the greedy policy of the fit is the one step lookahead on its values
+    srand(1);
+    LinearValue V = mdp.fittedValueIteration(LAMBDA, 0, 0, 1, 0,
+                                             FITTED_ITERATIONS, FITTED_BATCH,
+                                             0.1);
+    Expectimax greedy(1, 0, LAMBDA, V.evaluator());
+    std::unordered_map<State, Action> policy;
+    for (int s = 0; s < graph.size(); s++)
+    {
+        State state = graph.getState(s);
+        if (!state.getAvailableActions().empty())
+        {
+            Action action = greedy.chooseAction(state);
+            policy.emplace(std::move(state), action);
+        }
+    }
+    double fitted = mdp.compilePolicy(policy).expectedScore(random, 2000);
+
+    RandomPlayer randomPlayer;
+    Field field(3, 3);
+    Game game(field);
+    std::unordered_map<State, std::unique_ptr<Tromino>> randomPieces;
+    int randomTotal = 0;
+    for (int g = 0; g < FITTED_RANDOM_GAMES; g++)
+    {
+        srand(g + 1);
+        randomTotal += mdp.playPolicy(game, randomPlayer, randomPieces);
+    }
+    double randomMean = (double)randomTotal / FITTED_RANDOM_GAMES;
+
+    std::cout << "  expected score over 2000 moves: " << fitted
+              << " fitted, " << exact << " exact, random scores "
+              << randomMean << " in a game" << std::endl;
+    CHECK(fitted > 10 * randomMean);
+    CHECK_NEAR(fitted, exact, FITTED_MARGIN * exact);
+}
+
+TEST(checkpointResume)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    std::string path =
+        (std::filesystem::temp_directory_path() / "tetris_resume.ckpt")
+            .string();
+    MDP full(4, 4, emptyState(4, 4, I_PIECE));
+    CompactPolicy expected = full.compactPolicy(
+        full.actionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON, MAX_IT));
+
+    // stopped after 12 sweeps, with snapshots every 5 and after the last
+    {
+        MDP stopped(4, 4, emptyState(4, 4, I_PIECE));
+        stopped.setCheckpoint(path, 5);
+        stopped.actionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON, 12);
+    }
+    CHECK(!std::filesystem::exists(path + ".tmp"));
+    Checkpoint checkpoint = Checkpoint::load(path);
+    CHECK_EQ(checkpoint.iteration, 11);
+    CHECK_EQ(checkpoint.width, 4);
+    CHECK_EQ(checkpoint.nbPieces, 2);
+
+    MDP resumed(4, 4, emptyState(4, 4, I_PIECE));
+    CompactPolicy policy = resumed.compactPolicy(
+        resumed.resumeActionValueIteration(path, LAMBDA, 0, 0, 1, 0, EPSILON,
+                                           MAX_IT));
+    CHECK_EQ(policy.diff(expected), (size_t)0);
+
+    // a save then load keeps everything
+    std::string copy = path + ".copy";
+    checkpoint.save(copy);
+    Checkpoint back = Checkpoint::load(copy);
+    CHECK(back.keys == checkpoint.keys);
+    CHECK(back.values == checkpoint.values);
+    CHECK_EQ(back.delta, checkpoint.delta);
+
+    std::uintmax_t size = std::filesystem::file_size(copy);
+    std::filesystem::resize_file(copy, size - 1);
+    CHECK(exitsWithError([&] { Checkpoint::load(copy); }));
+    std::filesystem::resize_file(copy, size / 2);
+    CHECK(exitsWithError([&] { Checkpoint::load(copy); }));
+
+    // a wrong magic, then a state count larger than the file
+    checkpoint.save(copy);
+    std::fstream file(copy, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(0);
+    file.put('X');
+    file.flush();
+    CHECK(exitsWithError([&] { Checkpoint::load(copy); }));
+    checkpoint.save(copy);
+    file = std::fstream(copy, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(39); // top byte of the state count, after 32 header bytes
+    file.put(0x7f);
+    file.close();
+    CHECK(exitsWithError([&] { Checkpoint::load(copy); }));
+
+    // a snapshot that cannot replace its path is an error, not a silent
+    // stale checkpoint
+    std::filesystem::remove(copy);
+    std::filesystem::create_directories(copy + "/taken");
+    CHECK(exitsWithError([&] { checkpoint.save(copy); }));
+    CHECK(std::filesystem::is_directory(copy));
+
+    std::filesystem::remove(path);
+    std::filesystem::remove_all(copy);
+    std::filesystem::remove(copy + ".tmp");
+}
+
+TEST(compactPolicyDiff)
+{
+    PieceSetGuard pieces(PieceSet::trominoes());
+    for (auto [width, height] : {std::pair(3, 3), std::pair(3, 4),
+                                 std::pair(4, 4)})
+    {
+        MDP mdp(width, height, emptyState(width, height, I_PIECE));
+        CompactPolicy a = mdp.compactPolicy(
+            mdp.acceleratedActionValueIteration(LAMBDA, 0, 0, 1, 0, EPSILON,
+                                                MAX_IT, 5));
+        CompactPolicy b = mdp.compactPolicy(
+            mdp.acceleratedActionValueIteration(0.5, 0, 1, 1, 1, EPSILON,
+                                                MAX_IT, 5));
+        CHECK(a.size() % 64 != 0);
+
+        size_t naive = 0;
+        for (int s = 0; s < a.size(); s++)
+        {
+            naive += a.getIndex(s) != b.getIndex(s);
+        }
+        CHECK(naive > 0);
+        CHECK_EQ(a.diff(b), naive);
+        CHECK_EQ(b.diff(a), naive);
+        CHECK_EQ(a.diff(a), (size_t)0);
+    }
+}
+
+TEST(adversaryPolicies)
+{
+    Golden golden("solvers_4x4.txt");
+    PieceSetGuard pieces(PieceSet::trominoes());
+    MDP mdp(4, 4, emptyState(4, 4, I_PIECE));
+
+    golden.check("minmax_adversary",
+                 checksum(mdp.compileAdversary(mdp.trominoValueIterationMinMax(
+                     EPSILON, MAX_IT, ADVERSARY_LAMBDA))));
+    golden.check("minavg_adversary",
+                 checksum(mdp.compileAdversary(mdp.trominoValueIterationMinAvg(
+                     EPSILON, MAX_IT, ADVERSARY_LAMBDA))));
+    golden.check("gapavg_adversary",
+                 checksum(mdp.compileAdversary(mdp.trominoValueIterationGapAvg(
+                     EPSILON, MAX_IT, ADVERSARY_LAMBDA))));
+
+    GameSolution game = mdp.gameValueIteration(EPSILON, MAX_IT, LAMBDA);
+    golden.check("game_value", game.value);
+    golden.check("game_policy",
+                 checksum(mdp.compactPolicy(game.actions).getIndices()));
+    golden.check("game_adversary",
+                 checksum(mdp.compileAdversary(game.trominos)));
+}
@@ -0,0 +1,81 @@
+#include "Arena.h"
+#include "Tests.h"
+#include "Tromino.h"
+#include <thread>
+#include <unordered_set>
+
+// The allocators of the hot paths: the arena scopes of the solvers and the
+// block lists of the pieces. They are only checked through their public
+// behavior, the addresses they hand out.
+
+#define MEMORY_TROMINOES 20000 // several refills and spills of a block list
+
+TEST(arenaScopeRewinds)
+{
+    Arena arena;
+    void* first;
+    {
+        Arena::Scope scope(arena);
+        CHECK(Arena::current() == &arena);
+        first = Arena::current()->allocate(64, 8);
+        CHECK(Arena::current()->allocate(256, 8) != first);
+    }
+    CHECK(Arena::current() == std::pmr::new_delete_resource());
+
+    // a new scope starts where the previous one started
+    {
+        Arena::Scope scope(arena);
+        CHECK(Arena::current()->allocate(64, 8) == first);
+
+        // an inner scope gives back only what it allocated
+        void* inner;
+        {
+            Arena::Scope nested(arena);
+            inner = Arena::current()->allocate(64, 8);
+            CHECK(inner != first);
+        }
+        CHECK(Arena::current() == &arena);
+        CHECK(Arena::current()->allocate(64, 8) == inner);
+    }
+    CHECK(Arena::current() == std::pmr::new_delete_resource());
+}
+
+TEST(trominoBlocksReturnAcrossThreads)
+{
+    // allocated here, freed on one thread, allocated again on another
+    std::vector<Tromino*> pieces(MEMORY_TROMINOES);
+    std::unordered_set<void*> blocks;
+    for (Tromino*& piece : pieces)
+    {
+        piece = new Tromino(0);
+        blocks.insert(piece);
+    }
+    std::thread freeing(
+        [&]
+        {
+            for (Tromino* piece : pieces)
+            {
+                delete piece;
+            }
+        });
+    freeing.join();
+
+    // the freeing thread spilled its long list and gave the rest back on
+    // exit, so a new thread is served from those blocks before the heap
+    size_t reused = 0;
+    std::thread allocating(
+        [&]
+        {
+            for (Tromino*& piece : pieces)
+            {
+                piece = new Tromino(1);
+                reused += blocks.count(piece);
+            }
+            for (Tromino* piece : pieces)
+            {
+                delete piece;
+            }
+        });
+    allocating.join();
+    CHECK_EQ(reused, (size_t)MEMORY_TROMINOES);
+}
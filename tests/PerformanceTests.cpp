@@ -0,0 +1,392 @@
+#include "Expectimax.h"
+#include "MCTS.h"
+#include "MDP.h"
+#include "PolicyServer.h"
+#include "Profiler.h"
+#include "Tests.h"
+#include "Trace.h"
+#include "Workers.h"
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
+// Throughput floors on the 4x4 trominoes problem. They sit well below what
+// the current code reaches on a laptop (see the printed rates) so that only
+// a real regression trips them, not a busy machine.
+
+#define MIN_SWEEPS_PER_SECOND 100.0
+#define MIN_MAP_SWEEPS_PER_SECOND 2.0
+#define MIN_GAMES_PER_SECOND 500.0
+#define PERF_SWEEPS 200
+#define PERF_MAP_SWEEPS 10
+#define PERF_GAMES 2000
+#define PERF_TRACED_GAMES 1 // of up to MAX_ACTION moves
+#define PERF_TRACE_ROUNDS 61
+#define MAX_TRACE_OVERHEAD 0.05
+#define PERF_QUERIES 20000
+#define EXPECTIMAX_BUDGET_MS 20.0
+#define MCTS_BUDGET_MS 20.0
+#define MAX_QUERY_MICROSECONDS 100.0
+#define POOL_WORKERS 4
+#define PERF_DISPATCHES 2000
+// direct-mapped cache of 512 lines of 64 bytes (a 32KB L1) for the values
+#define SIM_CACHE_LINES 512
+#define SIM_VALUES_PER_LINE 8
+
+namespace
+{
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+State emptyState() { return State(Field(4, 4), nullptr); }
+
+// misses of a sweep reading V[next] for every transition in id order
+long simulatedMisses(const StateGraph& graph)
+{
+    std::vector<int64_t> cache(SIM_CACHE_LINES, -1);
+    long misses = 0;
+    for (const Transition& t : graph.getTransitions())
+    {
+        int64_t line = t.next / SIM_VALUES_PER_LINE;
+        int64_t& slot = cache[line % SIM_CACHE_LINES];
+        if (slot != line)
+        {
+            slot = line;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+double backupsPerSecond(const StateGraph& graph)
+{
+    size_t nbTransitions = graph.getTransitions().size();
+    BellmanBackup backup(graph, std::vector<double>(nbTransitions, 1.0),
+                         std::vector<double>(nbTransitions, 0.45));
+    std::vector<double> V(graph.size(), 0.0), VOut(graph.size());
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < PERF_SWEEPS; i++)
+    {
+        backup.expectationMax(V, VOut, nullptr);
+        V.swap(VOut);
+    }
+    return PERF_SWEEPS / secondsSince(start);
+}
+} // namespace
+
+TEST(graphSweepThroughput)
+{
+    MDP mdp(4, 4, emptyState());
+    mdp.getGraph();
+
+    // epsilon 0 and no acceleration: exactly PERF_SWEEPS Jacobi sweeps
+    auto start = std::chrono::steady_clock::now();
+    mdp.acceleratedActionValueIteration(0.9, 0, 0, 1, 0, 0.0, PERF_SWEEPS, 0);
+    double rate = PERF_SWEEPS / secondsSince(start);
+
+    std::cout << "  graph sweeps/s: " << rate << std::endl;
+    CHECK(rate >= MIN_SWEEPS_PER_SECOND);
+}
+
+TEST(bellmanKernelThroughput)
+{
+    MDP mdp(4, 4, emptyState());
+    const StateGraph& graph = mdp.getGraph();
+    size_t nbTransitions = graph.getTransitions().size();
+    BellmanBackup backup(graph, std::vector<double>(nbTransitions, 1.0),
+                         std::vector<double>(nbTransitions, 0.45));
+    std::vector<double> V(graph.size(), 0.0), VOut(graph.size());
+
+    for (const BellmanBackup::Kernel& kernel : BellmanBackup::kernels())
+    {
+        backup.setKernel(kernel.run);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < PERF_SWEEPS; i++)
+        {
+            backup.expectationMax(V, VOut, nullptr);
+            V.swap(VOut);
+        }
+        double rate = PERF_SWEEPS / secondsSince(start);
+        std::cout << "  " << kernel.name << " backups/s: " << rate << std::endl;
+        CHECK(rate >= MIN_SWEEPS_PER_SECOND);
+    }
+}
+
+TEST(stateOrderLocality)
+{
+    // a random numbering stands for the iteration order of a hash map
+    StateGraph graph(emptyState(), 1);
+    std::vector<int32_t> shuffled = graph.ordering(ORDER_BFS);
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(1));
+    graph.renumber(shuffled);
+    long hashMisses = simulatedMisses(graph);
+    std::cout << "  hash order: " << hashMisses << " misses, "
+              << backupsPerSecond(graph) << " backups/s" << std::endl;
+
+    std::pair<StateOrder, const char*> orders[] = {
+        {ORDER_BFS, "bfs"}, {ORDER_RCM, "rcm"}, {ORDER_HEIGHT, "height"}};
+    for (auto [order, name] : orders)
+    {
+        graph.renumber(order);
+        long misses = simulatedMisses(graph);
+        std::cout << "  " << name << " order: " << misses << " misses, "
+                  << backupsPerSecond(graph) << " backups/s" << std::endl;
+        CHECK(2 * misses < hashMisses);
+    }
+}
+
+TEST(adversaryStartup)
+{
+    MDP mdp(4, 4, emptyState());
+    mdp.getGraph();
+
+    auto start = std::chrono::steady_clock::now();
+    mdp.trominoValueIterationMinMax(1e-8, 1000, 0.1);
+    mdp.trominoValueIterationMinAvg(1e-8, 1000, 0.1);
+    mdp.trominoValueIterationGapAvg(1e-8, 1000, 0.1);
+    double separate = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    mdp.adversaryValueIteration(1e-8, 1000, 0.1,
+                                std::thread::hardware_concurrency());
+    double fused = secondsSince(start);
+
+    std::cout << "  adversaries: " << separate << "s separately, " << fused
+              << "s fused" << std::endl;
+    CHECK(3 * fused < separate);
+}
+
+TEST(mapSweepThroughput)
+{
+    MDP mdp(4, 4, emptyState());
+
+    auto start = std::chrono::steady_clock::now();
+    mdp.actionValueIteration(0.9, 0, 0, 1, 0, 0.0, PERF_MAP_SWEEPS);
+    double rate = PERF_MAP_SWEEPS / secondsSince(start);
+
+    std::cout << "  map sweeps/s (with exploration): " << rate << std::endl;
+    CHECK(rate >= MIN_MAP_SWEEPS_PER_SECOND);
+}
+
+TEST(gameThroughput)
+{
+    MDP mdp(4, 4, emptyState());
+    CompiledPolicy policy =
+        mdp.compilePolicy(mdp.acceleratedActionValueIteration(
+            0.9, 0, 0, 1, 0, 1e-8, 1000, 5));
+    std::vector<int8_t> random(mdp.getGraph().size(), RANDOM_PIECE);
+
+    auto start = std::chrono::steady_clock::now();
+    long total = 0;
+    for (int g = 0; g < PERF_GAMES; g++)
+    {
+        total += policy.play(random);
+    }
+    double rate = PERF_GAMES / secondsSince(start);
+
+    std::cout << "  games/s: " << rate << " (mean score "
+              << (double)total / PERF_GAMES << ")" << std::endl;
+    CHECK(rate >= MIN_GAMES_PER_SECOND);
+}
+
+TEST(traceOverhead)
+{
+    MDP mdp(4, 4, emptyState());
+    std::unordered_map<State, Action> policy =
+        mdp.acceleratedActionValueIteration(0.9, 0, 0, 1, 0, 1e-8, 1000, 5);
+    std::unordered_map<State, std::unique_ptr<Tromino>> random;
+    Field field(4, 4);
+    Game game(field);
+    std::string path =
+        (std::filesystem::temp_directory_path() / "tetris_trace_perf.trc")
+            .string();
+
+    // Each round plays the same games with and without tracing (the pieces
+    // come from rand(), reseeded before each run), the first variant
+    // alternating. The median of the per-round time ratios is kept since
+    // the machine drifts more between rounds than within one.
+    auto play = [&](bool trace, int round)
+    {
+        srand(round + 1);
+        if (trace)
+        {
+            TraceRecorder::open(path, 4, 4);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int g = 0; g < PERF_TRACED_GAMES; g++)
+        {
+            mdp.playPolicy(game, policy, random);
+        }
+        if (trace)
+        {
+            TraceRecorder::close();
+        }
+        return secondsSince(start);
+    };
+    std::vector<double> ratios;
+    double plain = 0, traced = 0;
+    size_t moves = 0;
+    for (int round = 0; round < PERF_TRACE_ROUNDS; round++)
+    {
+        bool tracedFirst = round % 2;
+        double first = play(tracedFirst, round);
+        double second = play(!tracedFirst, round);
+        double t = tracedFirst ? first : second;
+        double p = tracedFirst ? second : first;
+        ratios.push_back(t / p);
+        plain += p;
+        traced += t;
+        moves += readTrace(path).records.size();
+    }
+    std::filesystem::remove(path);
+    std::sort(ratios.begin(), ratios.end());
+    double overhead = ratios[ratios.size() / 2] - 1;
+
+    std::cout << "  moves/s: " << moves / plain << " untraced, "
+              << moves / traced << " traced, median overhead "
+              << 100 * overhead << "%" << std::endl;
+    CHECK(moves > 0);
+    CHECK(overhead <= MAX_TRACE_OVERHEAD);
+}
+
+TEST(policyQueryLatency)
+{
+    MDP mdp(4, 4, emptyState());
+    GameSolution game = mdp.gameValueIteration(1e-8, 1000, 0.9);
+    const StateGraph& graph = mdp.getGraph();
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string tablePath = (dir / "tetris_policy_perf.tbl").string();
+    std::string socketPath = (dir / "tetris_policy_perf.sock").string();
+    writePolicyTable(tablePath, graph, mdp.compactPolicy(game.actions),
+                     mdp.compileAdversary(game.trominos));
+
+    PolicyTable table(tablePath);
+    PolicyServer server(table, socketPath);
+    std::thread serving([&] { server.run(); });
+    PolicyClient client(socketPath);
+    std::mt19937 rng(3);
+
+    // one state per request, as a game server asking move by move
+    auto start = std::chrono::steady_clock::now();
+    for (int q = 0; q < PERF_QUERIES; q++)
+    {
+        client.query({graph.getKey(rng() % graph.size())});
+    }
+    double latency = secondsSince(start) / PERF_QUERIES * 1e6;
+
+    start = std::chrono::steady_clock::now();
+    client.query(std::vector<uint64_t>(graph.getKeys().begin(),
+                                       graph.getKeys().end()));
+    double batched = secondsSince(start) / graph.size() * 1e6;
+
+    server.stop();
+    serving.join();
+    std::filesystem::remove(tablePath);
+
+    std::cout << "  query round trip: " << latency << "us, batched: "
+              << batched << "us per state" << std::endl;
+    CHECK(latency < MAX_QUERY_MICROSECONDS);
+    CHECK(batched < latency);
+}
+
+TEST(expectimaxTimeBudget)
+{
+    // deep enough that only the clock stops the deepening
+    Expectimax player(1000, EXPECTIMAX_BUDGET_MS, 0.9,
+                      Expectimax::featureEvaluator(0.5, 1));
+    State state(Field(4, 4), std::make_unique<Tromino>(I_PIECE));
+
+    auto start = std::chrono::steady_clock::now();
+    player.chooseAction(state);
+    double elapsed = secondsSince(start) * 1000;
+
+    std::cout << "  expectimax: depth " << player.getLastDepth() << " in "
+              << elapsed << "ms for a " << EXPECTIMAX_BUDGET_MS
+              << "ms budget" << std::endl;
+    CHECK(player.getLastDepth() >= 1);
+    CHECK(player.getLastDepth() < 1000);
+    CHECK(elapsed < 2 * EXPECTIMAX_BUDGET_MS);
+}
+
+TEST(mctsTimeBudget)
+{
+    // enough iterations that only the clock stops the search
+    MCTS player(2, 1 << 30, MCTS_BUDGET_MS, 1.0, 0.9, 10,
+                Expectimax::featureEvaluator(0.5, 1));
+    State state(Field(4, 4), std::make_unique<Tromino>(I_PIECE));
+
+    auto start = std::chrono::steady_clock::now();
+    player.chooseAction(state);
+    double elapsed = secondsSince(start) * 1000;
+
+    std::cout << "  mcts: " << player.getLastIterations() << " iterations in "
+              << elapsed << "ms for a " << MCTS_BUDGET_MS << "ms budget"
+              << std::endl;
+    CHECK(player.getLastIterations() > 0);
+    CHECK(elapsed < 2 * MCTS_BUDGET_MS);
+}
+
+TEST(workerPoolDispatch)
+{
+    // the per-move and per-sweep loops hand tiny jobs to the same threads
+    std::vector<int> runs(POOL_WORKERS, 0);
+    auto job = [&](int w) { runs[w]++; };
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        WorkerPool workers(POOL_WORKERS);
+        CHECK_EQ(workers.size(), POOL_WORKERS);
+        for (int i = 0; i < PERF_DISPATCHES; i++)
+        {
+            workers.run(job);
+        }
+    }
+    double pooled = secondsSince(start) / PERF_DISPATCHES * 1e6;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < PERF_DISPATCHES; i++)
+    {
+        runWorkers(POOL_WORKERS, job);
+    }
+    double spawned = secondsSince(start) / PERF_DISPATCHES * 1e6;
+
+    std::cout << "  dispatch to " << POOL_WORKERS << " workers: " << pooled
+              << "us pooled, " << spawned << "us with new threads"
+              << std::endl;
+    CHECK(std::all_of(runs.begin(), runs.end(),
+                      [](int r) { return r == 2 * PERF_DISPATCHES; }));
+    CHECK(pooled < spawned);
+}
+
+TEST(profilerScopes)
+{
+#ifdef PROFILE
+    // built with `make PROFILE=1`: every scope and count is recorded once
+    // per call, nested ones included, on the calling thread only
+    State state(Field(4, 4), std::make_unique<Tromino>(I_PIECE));
+    uint64_t lines = profiler::calls(PROF_COMPLETE_LINES);
+    uint64_t clones = profiler::calls(PROF_STATE_CLONE);
+    uint64_t lookups = profiler::calls(PROF_MAP_LOOKUP);
+    for (int i = 0; i < 10; i++)
+    {
+        state.completeLines();
+        PROFILE_COUNT(PROF_MAP_LOOKUP);
+    }
+    std::thread other([&] { state.completeLines(); });
+    other.join();
+    CHECK_EQ(profiler::calls(PROF_COMPLETE_LINES) - lines, (uint64_t)10);
+    CHECK_EQ(profiler::calls(PROF_STATE_CLONE) - clones, (uint64_t)10);
+    CHECK_EQ(profiler::calls(PROF_MAP_LOOKUP) - lookups, (uint64_t)10);
+#else
+    // without PROFILE the macros drop their argument, so a point that does
+    // not exist compiles and nothing is called
+    PROFILE_SCOPE(NOT_A_PROFILE_POINT);
+    PROFILE_COUNT(NOT_A_PROFILE_POINT);
+#endif
+}
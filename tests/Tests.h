@@ -0,0 +1,85 @@
+#pragma once
+
+#include "PieceSet.h"
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Minimal test harness: TEST(name) registers a function, CHECK records a
+// failure and keeps going, `bin/tests` runs everything and returns non-zero
+// if anything failed.
+
+struct TestCase
+{
+    std::string name;
+    std::function<void()> run;
+};
+
+std::vector<TestCase>& testRegistry();
+void testFailure(const char* file, int line, const std::string& message);
+// --update-golden rewrites the golden files instead of comparing
+bool updatingGolden();
+// --fuzz-cases N overrides the number of random cases of the fuzz tests
+int fuzzCases(int defaultCases);
+
+// restores the default pieces whatever the test does
+struct PieceSetGuard
+{
+    explicit PieceSetGuard(PieceSet pieces)
+    {
+        PieceSet::set(std::move(pieces));
+    }
+    ~PieceSetGuard() { PieceSet::set(PieceSet::trominoes()); }
+};
+
+struct TestRegistrar
+{
+    TestRegistrar(const char* name, std::function<void()> run)
+    {
+        testRegistry().push_back({name, std::move(run)});
+    }
+};
+
+#define TEST(name)                                                             \
+    static void name();                                                        \
+    static TestRegistrar name##_registrar(#name, name);                        \
+    static void name()
+
+#define CHECK(cond)                                                            \
+    do                                                                         \
+    {                                                                          \
+        if (!(cond))                                                           \
+        {                                                                      \
+            testFailure(__FILE__, __LINE__, #cond);                            \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+    do                                                                         \
+    {                                                                          \
+        auto va_ = (a);                                                        \
+        auto vb_ = (b);                                                        \
+        if (!(va_ == vb_))                                                     \
+        {                                                                      \
+            std::ostringstream os_;                                            \
+            os_ << #a << " == " << #b << " (" << va_ << " vs " << vb_ << ")";  \
+            testFailure(__FILE__, __LINE__, os_.str());                        \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance)                                            \
+    do                                                                         \
+    {                                                                          \
+        double va_ = (a);                                                      \
+        double vb_ = (b);                                                      \
+        if (!(std::abs(va_ - vb_) <= (tolerance)))                             \
+        {                                                                      \
+            std::ostringstream os_;                                            \
+            os_.precision(17);                                                 \
+            os_ << #a << " ~ " << #b << " (" << va_ << " vs " << vb_ << ")";   \
+            testFailure(__FILE__, __LINE__, os_.str());                        \
+        }                                                                      \
+    } while (0)
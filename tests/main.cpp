@@ -0,0 +1,78 @@
+#include "Tests.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+int g_failures = 0;
+bool g_updateGolden = false;
+int g_fuzzCases = 0;
+} // namespace
+
+std::vector<TestCase>& testRegistry()
+{
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+void testFailure(const char* file, int line, const std::string& message)
+{
+    std::cerr << "  FAILED " << file << ":" << line << ": " << message
+              << std::endl;
+    g_failures++;
+}
+
+bool updatingGolden() { return g_updateGolden; }
+
+int fuzzCases(int defaultCases)
+{
+    return g_fuzzCases > 0 ? g_fuzzCases : defaultCases;
+}
+
+// usage: bin/tests [--update-golden] [--fuzz-cases N] [name filter]
+int main(int argc, char** argv)
+{
+    const char* filter = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--update-golden") == 0)
+        {
+            g_updateGolden = true;
+        }
+        else if (std::strcmp(argv[i], "--fuzz-cases") == 0 && i + 1 < argc)
+        {
+            g_fuzzCases = std::atoi(argv[++i]);
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    int failedTests = 0;
+    int ran = 0;
+    for (const TestCase& test : testRegistry())
+    {
+        if (filter && test.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        int before = g_failures;
+        std::cout << "[ RUN  ] " << test.name << std::endl;
+        test.run();
+        ran++;
+        if (g_failures > before)
+        {
+            failedTests++;
+            std::cout << "[ FAIL ] " << test.name << std::endl;
+        }
+        else
+        {
+            std::cout << "[  OK  ] " << test.name << std::endl;
+        }
+    }
+
+    std::cout << ran - failedTests << "/" << ran << " tests passed"
+              << std::endl;
+    return failedTests > 0;
+}